@@ -46,6 +46,7 @@
 #include "cbfifo.h"
 #include "systick.h"
 #include "statemachine.h"
+#include "console.h"
 
 #define ENABLE_LOGGING (1)
 
@@ -67,7 +68,6 @@ int main(void) {
     /***************************************************
      * 	       PERIPHERAL INITIALISATION
      **************************************************/
-    int status = 0;
 	uart0_init(); //Initialise UART0(Needed for enable console logging
 	gpio_init();  // PD0 acts as SPI chip select(initialise PD0)
     spi_init();   //Initialise SPI with CPHA=CPOL=0
@@ -75,23 +75,13 @@ int main(void) {
     uart1_init(); //Bluetooth module uses UART1 for sending data
     systick_init(); //Timer initialisation that fires every 3 seconds
 
-    //Create the Tx handle that points to tx buffer(statically allocated)
-    status |= create_tx_cb_handle();
-
+    //UART0 Tx and Rx rings are statically allocated and need no initialisation
 
     /***********************************************************************
-     * 	 Test whether Environmental sensor is connected by reading chip ID
+     * 	 Test whether Environmental sensors are connected by reading chip ID
+     * 	 and select sensor profile for the sampling period
      ***********************************************************************/
-    uint8_t chip_id = bme280_init();
-
-    if(chip_id != CHIP_REV)
-    {
-    	printf("The sensor did not respond with correct chip id val,Please check the connection\n\r");
-    }
-    else
-    {
-    	printf("BME280 sensor initialization is successfull\n\r");
-    }
+    weather_monitor_init();
 
     while(1)
     {
@@ -104,6 +94,8 @@ int main(void) {
 
     	weather_monitor_statemachine();
 
+    	console_poll(); //Debug commands on UART0
+
     }
     return 0 ;
 
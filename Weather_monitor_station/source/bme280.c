@@ -10,7 +10,7 @@
 //***********************************************************************************
 //                              Include files
 //***********************************************************************************
-#include "MKL25Z4.h"
+#include "reg_access.h"
 #include "spi.h"
 #include "bme280.h"
 #include "uart.h"
@@ -19,56 +19,194 @@
 //***********************************************************************************
 //                                  Macros
 //***********************************************************************************
-#define MIN_TEMP (-40)
-#define MAX_TEMP (50)
-#define MIN_HUM  (0)
-#define MAX_HUM  (100)
-#define MAX_PRES (0)
-#define MIN_PRES (10000)
+#define MIN_TEMP (-40 * 100) //0.01 DegC
+#define MAX_TEMP (50 * 100)
+#define MAX_HUM  (100UL << 10) //Q22.10 %RH, unsigned so there is no lower limit to check
+#define MIN_PRES (30000UL << 8) //Q24.8 Pa
+#define MAX_PRES (110000UL << 8)
+#define SENSOR_FRAME_MAX_LEN (96) //Longest frame of transmit_sensors_val is 82 bytes
 //***********************************************************************************
 //                              Structures
 //***********************************************************************************
-int32_t t_fine = 0;
+#define MODE_MASK		(0x03)
+#define OSRS_T(ctrl_meas)	(((ctrl_meas) >> 5) & 0x07)
+#define OSRS_P(ctrl_meas)	(((ctrl_meas) >> 2) & 0x07)
+#define OSRS_H(ctrl_hum)	((ctrl_hum) & 0x07)
+
+//Conversion time constants, t_measure = base + per_sample * osrs_t + (per_sample * osrs_p + startup) + ...
+typedef struct
+{
+	uint32_t base_us;
+	uint32_t per_sample_us;
+	uint32_t startup_us;
+}t_meas_t;
+
+static const t_meas_t t_meas_typ = {1000, 2000, 500};
+static const t_meas_t t_meas_max = {1250, 2300, 575};
+#define T_MEAS_TYP_US		(&t_meas_typ)
+#define T_MEAS_MAX_US		(&t_meas_max)
+
+//Supply current while measuring each quantity and while idle, in nA (datasheet section 1)
+#define IDD_T_NA			(350000UL)
+#define IDD_P_NA			(714000UL)
+#define IDD_H_NA			(340000UL)
+#define IDD_SLEEP_NA		(100UL)
+#define IDD_STANDBY_NA		(200UL)
+
+//Standby time in normal mode for each t_sb register value
+static const uint32_t standby_time_us[8] = {500, 62500, 125000, 250000, 500000, 1000000, 10000, 20000};
+
+//Recommended settings from datasheet section 3.5, used with bme280_apply_profile
+static const bme280_config_t profiles[BME280_NUM_PROFILES] =
+{
+	[BME280_PROFILE_WEATHER_MONITORING] = {.osrs_t = 1, .osrs_p = 1, .osrs_h = 1, .filter = 0, .standby = 0, .mode = MODE_FORCED},
+	[BME280_PROFILE_HUMIDITY_SENSING] = {.osrs_t = 1, .osrs_p = 0, .osrs_h = 1, .filter = 0, .standby = 0, .mode = MODE_FORCED},
+	[BME280_PROFILE_INDOOR_NAVIGATION] = {.osrs_t = 2, .osrs_p = 16, .osrs_h = 1, .filter = 4, .standby = 0, .mode = MODE_NORMAL},
+	[BME280_PROFILE_GAMING] = {.osrs_t = 1, .osrs_p = 4, .osrs_h = 0, .filter = 4, .standby = 0, .mode = MODE_NORMAL},
+};
 
 
 //***********************************************************************************
 //                                  Function definition
 //***********************************************************************************
+/*---------------------------------------------------*/
+/*
+ @brief: Write a control register and keep its shadow copy in sync
+ @param: dev: Sensor handle
+ 	 	 reg_addr: Register that is to be written
+ 	 	 data: Value to be written
+ 	 	 shadow: Shadow copy of the register
+ @return:None
+ @Reference:
+-------------------------------------------------*/
+static void write_register_shadowed(const bme280_dev_t* dev, uint8_t reg_addr, uint8_t data, uint8_t* shadow)
+{
+	SPI_write_register(&dev->cs, reg_addr, data);
+	*shadow = data;
+}
+
 /*---------------------------------------------------*/
 /*
  @brief: Initialise BME280 sensor
-@param: None
+@param: dev: Sensor handle
  @return:None
  @Reference:
 -------------------------------------------------*/
-uint8_t bme280_init()
+uint8_t bme280_init(bme280_dev_t* dev)
 {
-	uint8_t standby = 0; //0.5ms
-	uint8_t filter = 0; //Filter off
-	uint8_t temp_over_sample = 1;
-	uint8_t press_over_sample = 1;
-	uint8_t humid_over_sample = 1;
-//
-//	//Most of the time the sensor will be init with default values
-//	//But in case user has old/deprecated code, use the settings.x values
-	uint8_t read_data = 0;
-	set_standby_time(standby);
-	set_filter(filter);
-	set_pressure_oversample(press_over_sample); //Default of 1x oversample
-	set_humidity_oversample(humid_over_sample); //Default of 1x oversample
-	set_temp_oversample(temp_over_sample); //Default of 1x oversample
-//
-	set_mode(MODE_NORMAL); //Go!
+	bme280_config_t config =
+	{
+		.osrs_t = 1, //Default of 1x oversample
+		.osrs_p = 1,
+		.osrs_h = 1,
+		.filter = 0, //Filter off
+		.standby = 0, //0.5ms
+		.mode = MODE_SLEEP //Conversions are triggered one at a time in forced mode
+	};
 
+	uint8_t read_data = 0;
+	bme280_read_calibration(dev, &dev->calib); //Trimming values never change, read them only once
+	bme280_resync(dev); //Sensor may not be in reset state if only the MCU was reset
+	bme280_apply_config(dev, &config);
 
-	SPI_read_register(BME280_CHIP_ID_REG, &read_data);
+	SPI_read_register(&dev->cs, BME280_CHIP_ID_REG, &read_data);
 	return read_data; //Should return 0x60
 }
 
+/*---------------------------------------------------*/
+/*
+ @brief: Program oversampling, filter, standby time and mode in one go.
+ 	 	 Sensor is put to sleep once (if it is not already), then ctrl_hum, config
+ 	 	 and ctrl_meas are written in that order (ctrl_hum only takes effect
+ 	 	 after ctrl_meas write).
+ @param: dev: Sensor handle
+ 	 	 config: Settings to be programmed. Oversampling values are 0 to 16,
+ 	 	 filter and standby are register values (see set_filter, set_standby_time)
+ @return:None
+ @Reference: BME280 datasheet section 5.4
+-------------------------------------------------*/
+void bme280_apply_config(bme280_dev_t* dev, const bme280_config_t* config)
+{
+	uint8_t mode = (config->mode > 0x3) ? MODE_SLEEP : config->mode; //Error check. Default to sleep mode
+	uint8_t filter = (config->filter > 0x7) ? 0 : config->filter;
+	uint8_t standby = (config->standby > 0x7) ? 0 : config->standby;
+
+	uint8_t ctrl_meas = (check_sample_value(config->osrs_t) << 5) | (check_sample_value(config->osrs_p) << 2);
+
+	if((dev->reg_ctrl_meas & MODE_MASK) != MODE_SLEEP)
+	{
+		write_register_shadowed(dev, BME280_CTRL_MEAS_REG, ctrl_meas | MODE_SLEEP, &dev->reg_ctrl_meas); //Config is only writeable in sleep mode
+	}
+	write_register_shadowed(dev, BME280_CTRL_HUMIDITY_REG, check_sample_value(config->osrs_h), &dev->reg_ctrl_hum);
+	write_register_shadowed(dev, BME280_CONFIG_REG, (standby << 5) | (filter << 2), &dev->reg_config);
+	write_register_shadowed(dev, BME280_CTRL_MEAS_REG, ctrl_meas | mode, &dev->reg_ctrl_meas);
+
+	if(mode != MODE_NORMAL)
+	{
+		dev->reg_ctrl_meas &= ~MODE_MASK; //Forced conversion ends in sleep mode by itself
+	}
+}
+
+/*---------------------------------------------------*/
+/*
+ @brief: Reload the shadow copies from the sensor, e.g. after a sensor reset
+ 	 	 or power cycle changed the control registers behind the driver's back
+ @param: dev: Sensor handle
+ @return:None
+ @Reference:
+-------------------------------------------------*/
+void bme280_resync(bme280_dev_t* dev)
+{
+	uint8_t regs[BME280_CONFIG_REG - BME280_CTRL_HUMIDITY_REG + 1]; //0xF2 to 0xF5
+
+	SPI_multibyte_read_register(&dev->cs, BME280_CTRL_HUMIDITY_REG, regs, sizeof(regs));
+
+	dev->reg_ctrl_hum = regs[0];
+	dev->reg_ctrl_meas = regs[BME280_CTRL_MEAS_REG - BME280_CTRL_HUMIDITY_REG];
+	dev->reg_config = regs[BME280_CONFIG_REG - BME280_CTRL_HUMIDITY_REG];
+
+	if((dev->reg_ctrl_meas & MODE_MASK) != MODE_NORMAL)
+	{
+		dev->reg_ctrl_meas &= ~MODE_MASK; //Forced conversion in progress ends in sleep mode
+	}
+}
+
+/*---------------------------------------------------*/
+/*
+ @brief: Burst read the trimming parameters stored in sensor NVM
+ @param: dev: Sensor handle
+ 	 	 calib: Pointer to structure in which trimming values are stored
+ @return:None
+ @Reference: BME280 datasheet section 4.2.2
+-------------------------------------------------*/
+void bme280_read_calibration(const bme280_dev_t* dev, bme280_calib_t* calib)
+{
+	uint8_t tp[BME280_CALIB_TP_LEN]; //0x88 to 0xA1
+	uint8_t h[BME280_CALIB_H_LEN]; //0xE1 to 0xE7
+
+	SPI_multibyte_read_register(&dev->cs, BME280_DIG_T1_LSB_REG, tp, BME280_CALIB_TP_LEN);
+	SPI_multibyte_read_register(&dev->cs, BME280_DIG_H2_LSB_REG, h, BME280_CALIB_H_LEN);
+
+	bme280_parse_calibration(tp, h, calib);
+}
+
+/*---------------------------------------------------*/
+/*
+ @brief: Get the cached trimming parameters
+ @param: dev: Sensor handle
+ @return:Pointer to trimming values loaded during bme280_init
+ @Reference:
+-------------------------------------------------*/
+const bme280_calib_t* bme280_get_calibration(const bme280_dev_t* dev)
+{
+	return &dev->calib;
+}
+
 /*---------------------------------------------------*/
 /*
  @brief: Set standby time in the config register
- @param: timeSetting: Standby time
+ @param: dev: Sensor handle
+ 	 	 timeSetting: Standby time
   timeSetting can be:
   0, 0.5ms
   1, 62.5ms
@@ -81,21 +219,20 @@ uint8_t bme280_init()
  @return:None
  @Reference:
 -------------------------------------------------*/
-void set_standby_time(uint8_t timeSetting)
+void set_standby_time(bme280_dev_t* dev, uint8_t timeSetting)
 {
 	if(timeSetting > 0x7) timeSetting = 0; //Error check. Default to 0.5ms
 
-	uint8_t control_data = 0;
-	SPI_read_register(BME280_CONFIG_REG,&control_data);
+	uint8_t control_data = dev->reg_config;
 	control_data &= ~( (1<<7) | (1<<6) | (1<<5) ); //Clear the 7/6/5 bits
 	control_data |= (timeSetting << 5); //Align with bits 7/6/5
-	SPI_write_register(BME280_CONFIG_REG, control_data);
-	SPI_read_register(BME280_CONFIG_REG,&control_data);
+	write_register_shadowed(dev, BME280_CONFIG_REG, control_data, &dev->reg_config);
 }
 /*---------------------------------------------------*/
 /*
  @brief: Set filter in the config register
- @param: filter_setting
+ @param: dev: Sensor handle
+ 	 	 filter_setting
 filter can be off or number of FIR coefficients to use:
   0, filter off
   1, coefficients = 2
@@ -105,21 +242,21 @@ filter can be off or number of FIR coefficients to use:
  @return:None
  @Reference:
 -------------------------------------------------*/
-void set_filter(uint8_t filter_setting)
+void set_filter(bme280_dev_t* dev, uint8_t filter_setting)
 {
 	if(filter_setting > 0x07) filter_setting = 0; //Error check. Default to filter off
 
-	uint8_t control_data = 0;
-	SPI_read_register(BME280_CONFIG_REG,&control_data);
+	uint8_t control_data = dev->reg_config;
 	control_data &= ~( (1<<4) | (1<<3) | (1<<2) ); //Clear the 4/3/2 bits
 	control_data |= (filter_setting << 2); //Align with bits 4/3/2
-	SPI_write_register(BME280_CONFIG_REG, control_data);
+	write_register_shadowed(dev, BME280_CONFIG_REG, control_data, &dev->reg_config);
 }
 
 /*---------------------------------------------------*/
 /*
  @brief: Set the temperature oversample value
- @param: over_sample_amount
+ @param: dev: Sensor handle
+ 	 	 over_sample_amount
  0 turns off temp sensing
  1 to 16 are valid over sampling values
  @return:None
@@ -127,24 +264,28 @@ void set_filter(uint8_t filter_setting)
 -------------------------------------------------*/
 //
 
-void set_temp_oversample(uint8_t over_sample_amount)
+void set_temp_oversample(bme280_dev_t* dev, uint8_t over_sample_amount)
 {
 	over_sample_amount = check_sample_value(over_sample_amount); //Error check
 
-	uint8_t originalMode = get_mode(); //Get the current mode so we can go back to it at the end
+	uint8_t originalMode = get_mode(dev); //Get the current mode so we can go back to it at the end
 
-	set_mode(MODE_SLEEP); //Config will only be writeable in sleep mode, so first go to sleep mode
+	if(originalMode != MODE_SLEEP)
+	{
+		set_mode(dev, MODE_SLEEP); //Config will only be writeable in sleep mode, so first go to sleep mode
+	}
 
 	//Set the osrs_t bits (7, 6, 5) to overSampleAmount
-	uint8_t control_data = 0;
-	SPI_read_register(BME280_CTRL_MEAS_REG,&control_data);
+	uint8_t control_data = dev->reg_ctrl_meas;
 
 	control_data &= ~( (1<<7) | (1<<6) | (1<<5) ); //Clear bits 765
 	control_data |= over_sample_amount << 5; //Align overSampleAmount to bits 7/6/5
-	SPI_write_register(BME280_CTRL_MEAS_REG, control_data);
-
+	write_register_shadowed(dev, BME280_CTRL_MEAS_REG, control_data, &dev->reg_ctrl_meas);
 
-	set_mode(originalMode); //Return to the original user's choice
+	if(originalMode != MODE_SLEEP)
+	{
+		set_mode(dev, originalMode); //Return to the original user's choice
+	}
 }
 /*---------------------------------------------------*/
 /*
@@ -184,68 +325,75 @@ uint8_t check_sample_value(uint8_t user_value)
 
 /*---------------------------------------------------*/
 /*
- @brief: Gets the current mode bits in the ctrl_meas register
+ @brief: Gets the current mode bits from the ctrl_meas shadow register
 		 Mode 00 = Sleep
-		 01 and 10 = Forced
 		 11 = Normal mode
- @param: None.
+		 Forced mode is never returned, sensor goes back to sleep after the conversion
+ @param: dev: Sensor handle
  @return:Returns the value to be programmed.
  @Reference:
 -------------------------------------------------*/
-uint8_t get_mode()
+uint8_t get_mode(const bme280_dev_t* dev)
 {
-	uint8_t control_data = 0;
-	SPI_read_register(BME280_CTRL_MEAS_REG,&control_data);
-
-	return(control_data & 0x03); //Clear bits 7 through 2
+	return(dev->reg_ctrl_meas & MODE_MASK); //Clear bits 7 through 2
 }
 
 /*---------------------------------------------------*/
 /*
- @brief: Set the mode bits in the ctrl_meas register
+ @brief: Set the mode bits in the ctrl_meas register, costs a single SPI write
 		 Mode 00 = Sleep
 		 01 and 10 = Forced
 		 11 = Normal mode
- @param: None.
+ @param: dev: Sensor handle
  @return:Returns the value to be programmed.
  @Reference:
 -------------------------------------------------*/
-void set_mode(uint8_t mode)
+void set_mode(bme280_dev_t* dev, uint8_t mode)
 {
 	if(mode > 0x3) mode = 0; //Error check. Default to sleep mode
 
-	uint8_t control_data = 0;
-	SPI_read_register(BME280_CTRL_MEAS_REG,&control_data);
+	uint8_t control_data = dev->reg_ctrl_meas;
 	control_data &= ~( (1<<1) | (1<<0) ); //Clear the mode[1:0] bits
 	control_data |= mode; //Set
-	SPI_write_register(BME280_CTRL_MEAS_REG, control_data);
+	write_register_shadowed(dev, BME280_CTRL_MEAS_REG, control_data, &dev->reg_ctrl_meas);
+
+	if(mode != MODE_NORMAL)
+	{
+		dev->reg_ctrl_meas &= ~MODE_MASK; //Forced conversion ends in sleep mode by itself
+	}
 }
 /*---------------------------------------------------*/
 /*
  @brief: Set the pressure oversample value
 		0 turns off pressure sensing
 		1 to 16 are valid over sampling values
- @param: over_sample_amount: Over sample amount to be set.
+ @param: dev: Sensor handle
+ 	 	 over_sample_amount: Over sample amount to be set.
  @return:None.
  @Reference:
 -------------------------------------------------*/
-void set_pressure_oversample(uint8_t over_sample_amount)
+void set_pressure_oversample(bme280_dev_t* dev, uint8_t over_sample_amount)
 {
 	over_sample_amount = check_sample_value(over_sample_amount); //Error check
 
-	uint8_t original_mode = get_mode(); //Get the current mode so we can go back to it at the end
+	uint8_t original_mode = get_mode(dev); //Get the current mode so we can go back to it at the end
 
-	set_mode(MODE_SLEEP); //Config will only be writeable in sleep mode, so first go to sleep mode
+	if(original_mode != MODE_SLEEP)
+	{
+		set_mode(dev, MODE_SLEEP); //Config will only be writeable in sleep mode, so first go to sleep mode
+	}
 
 	//Set the osrs_p bits (4, 3, 2) to overSampleAmount
-	uint8_t control_data = 0;
-	SPI_read_register(BME280_CTRL_MEAS_REG,&control_data);
+	uint8_t control_data = dev->reg_ctrl_meas;
 
 	control_data &= ~( (1<<4) | (1<<3) | (1<<2) ); //Clear bits 432
 	control_data |= over_sample_amount << 2; //Align overSampleAmount to bits 4/3/2
-	SPI_write_register(BME280_CTRL_MEAS_REG, control_data);
+	write_register_shadowed(dev, BME280_CTRL_MEAS_REG, control_data, &dev->reg_ctrl_meas);
 
-	set_mode(original_mode); //Return to the original user's choice
+	if(original_mode != MODE_SLEEP)
+	{
+		set_mode(dev, original_mode); //Return to the original user's choice
+	}
 }
 
 /*---------------------------------------------------*/
@@ -253,328 +401,566 @@ void set_pressure_oversample(uint8_t over_sample_amount)
  @brief: Set the humidity oversample value
 		0 turns off humidity sensing
 		1 to 16 are valid over sampling values
- @param: over_sample_amount: Over sample amount to be set.
+ @param: dev: Sensor handle
+ 	 	 over_sample_amount: Over sample amount to be set.
  @return:None.
  @Reference:
 -------------------------------------------------*/
-void set_humidity_oversample(uint8_t over_sample_amount)
+void set_humidity_oversample(bme280_dev_t* dev, uint8_t over_sample_amount)
 {
 	over_sample_amount = check_sample_value(over_sample_amount); //Error check
 
-	uint8_t original_mode = get_mode(); //Get the current mode so we can go back to it at the end
+	uint8_t original_mode = get_mode(dev); //Get the current mode so we can go back to it at the end
 
-	set_mode(MODE_SLEEP); //Config will only be writeable in sleep mode, so first go to sleep mode
+	if(original_mode != MODE_SLEEP)
+	{
+		set_mode(dev, MODE_SLEEP); //Config will only be writeable in sleep mode, so first go to sleep mode
+	}
 
 	//Set the osrs_h bits (2, 1, 0) to overSampleAmount
-	uint8_t control_data = 0;
-	SPI_read_register(BME280_CTRL_HUMIDITY_REG,&control_data);
+	uint8_t control_data = dev->reg_ctrl_hum;
 
 	control_data &= ~( (1<<2) | (1<<1) | (1<<0) ); //Clear bits 2/1/0
 	control_data |= over_sample_amount << 0; //Align overSampleAmount to bits 2/1/0
-	SPI_write_register(BME280_CTRL_HUMIDITY_REG, control_data);
+	write_register_shadowed(dev, BME280_CTRL_HUMIDITY_REG, control_data, &dev->reg_ctrl_hum);
 
-	set_mode(original_mode); //Return to the original user's choice
+	set_mode(dev, original_mode); //ctrl_hum only takes effect after a ctrl_meas write
 }
 
 /*---------------------------------------------------*/
 /*
- @brief: Read temperature values in celsius
- @param: None.
- @return:None.
+ @brief: Convert oversampling register value to number of samples
+ @param: osrs: Value programmed in osrs_x bits (0 to 5)
+ @return: Number of samples, 0 if measurement is skipped
  @Reference:
 -------------------------------------------------*/
-float read_temp_C( void )
+static uint32_t oversample_count(uint8_t osrs)
 {
-	// Returns temperature in DegC, resolution is 0.01 DegC. Output value of “5123” equals 51.23 DegC.
-	// t_fine carries fine temperature as global value
+	return (osrs == 0) ? 0 : (1 << (osrs - 1));
+}
 
-	//get the reading (adc_T);
-    uint8_t buffer[3];
+/*---------------------------------------------------*/
+/*
+ @brief: Time taken by one conversion for given oversampling
+ @param: osrs_t, osrs_p, osrs_h: Values programmed in osrs_x bits (0 to 5)
+ 	 	 timing: Typical or maximum timing constants
+ @return: Conversion time in us
+ @Reference: BME280 datasheet section 9.1
+-------------------------------------------------*/
+static uint32_t conversion_time_us(uint8_t osrs_t, uint8_t osrs_p, uint8_t osrs_h, const t_meas_t* timing)
+{
+	uint32_t time_us = timing->base_us + (timing->per_sample_us * oversample_count(osrs_t));
 
-    SPI_read_register(BME280_TEMPERATURE_MSB_REG, &buffer[0]);
-    SPI_read_register(BME280_TEMPERATURE_LSB_REG, &buffer[1]);
-    SPI_read_register(BME280_TEMPERATURE_XLSB_REG, &buffer[2]);
-    int32_t adc_T = ((uint32_t)buffer[0] << 12) | ((uint32_t)buffer[1] << 4) | ((buffer[2] >> 4) & 0x0F);
+	if(osrs_p)
+	{
+		time_us += (timing->per_sample_us * oversample_count(osrs_p)) + timing->startup_us;
+	}
+	if(osrs_h)
+	{
+		time_us += (timing->per_sample_us * oversample_count(osrs_h)) + timing->startup_us;
+	}
 
+	return time_us;
+}
 
-	uint16_t T1_MSB = 0;
-	uint16_t T1_LSB = 0;
-	uint16_t T1 = 0;
-	SPI_read_register(BME280_DIG_T1_MSB_REG, (uint8_t*)&T1_MSB);
-	SPI_read_register(BME280_DIG_T1_LSB_REG, (uint8_t*)&T1_LSB);
-	T1 = (T1_MSB << 8) | (T1_LSB);
+/*---------------------------------------------------*/
+/*
+ @brief: Maximum time taken by one conversion with the current oversampling
+ @param: dev: Sensor handle
+ @return: Conversion time in us
+ @Reference: BME280 datasheet section 9.1, t_measure,max
+-------------------------------------------------*/
+uint32_t bme280_measurement_time_us(const bme280_dev_t* dev)
+{
+	return conversion_time_us(OSRS_T(dev->reg_ctrl_meas), OSRS_P(dev->reg_ctrl_meas), OSRS_H(dev->reg_ctrl_hum), T_MEAS_MAX_US);
+}
 
-	uint16_t T2_MSB = 0;
-	uint16_t T2_LSB = 0;
-	uint16_t T2 = 0;
-	SPI_read_register(BME280_DIG_T2_MSB_REG, (uint8_t*)&T2_MSB);
-	SPI_read_register(BME280_DIG_T2_LSB_REG, (uint8_t*)&T2_LSB);
-	T2 = (T2_MSB << 8) | (T2_LSB);
+/*---------------------------------------------------*/
+/*
+ @brief: Start a single conversion in forced mode. Sensor goes back to
+ 	 	 sleep mode by itself once the conversion is done.
+ @param: dev: Sensor handle
+ @return: Time after which results are expected, in us
+ @Reference: BME280 datasheet section 3.3.3
+-------------------------------------------------*/
+uint32_t bme280_trigger_forced(bme280_dev_t* dev)
+{
+	set_mode(dev, MODE_FORCED);
 
-	uint16_t T3_MSB = 0;
-	uint16_t T3_LSB = 0;
-	uint16_t T3 = 0;
-	SPI_read_register(BME280_DIG_T3_MSB_REG, (uint8_t*)&T3_MSB);
-	SPI_read_register(BME280_DIG_T3_LSB_REG, (uint8_t*)&T3_LSB);
-	T3 = (T3_MSB << 8) | (T3_LSB);
+	return bme280_measurement_time_us(dev);
+}
+
+/*---------------------------------------------------*/
+/*
+ @brief: Check the measuring bit of the status register
+ @param: dev: Sensor handle
+ @return: 1 while conversion is running, 0 once results are in data registers
+ @Reference:
+-------------------------------------------------*/
+uint8_t bme280_is_measuring(const bme280_dev_t* dev)
+{
+	uint8_t status = 0;
+	SPI_read_register(&dev->cs, BME280_STAT_REG, &status);
 
-	//By datas																																																				heet, calibrate
-	int64_t var1, var2;
-	var1 = ((((adc_T>>3) - ((int32_t)T1<<1))) * ((int32_t)T2)) >> 11;
-	var2 = (((((adc_T>>4) - ((int32_t)T1)) * ((adc_T>>4) - ((int32_t)T1))) >> 12) *
-	((int32_t)T3)) >> 14;
-	t_fine = var1 + var2;
-	float output = (t_fine * 5 + 128) >> 8;
+	return (status & BME280_STAT_MEASURING_MASK) ? 1 : 0;
+}
 
-	float temp_correction = 0.f;
-	output = output / 100 + temp_correction;
+/*---------------------------------------------------*/
+/*
+ @brief: Get the settings of a recommended use-case profile
+ @param: profile: Profile to look up
+ @return: Pointer to profile settings, NULL for an invalid profile
+ @Reference: BME280 datasheet section 3.5
+-------------------------------------------------*/
+const bme280_config_t* bme280_get_profile(bme280_profile_e profile)
+{
+	if(profile >= BME280_NUM_PROFILES)
+	{
+		return NULL;
+	}
 
-	return output;
+	return &profiles[profile];
 }
 
 /*---------------------------------------------------*/
 /*
- @brief: Read humidity in float
- @param: None.
- @return: humidity value in %RH
+ @brief: Switch the sensor to a recommended use-case profile at runtime
+ @param: dev: Sensor handle
+ 	 	 profile: Profile to be applied
+ 	 	 mode: Mode to run the profile in, e.g. MODE_SLEEP when conversions
+ 	 	 	   are triggered one at a time with bme280_trigger_forced
+ @return: None
  @Reference:
 -------------------------------------------------*/
-float read_float_humidity( void )
+void bme280_apply_profile(bme280_dev_t* dev, bme280_profile_e profile, uint8_t mode)
+{
+	const bme280_config_t* preset = bme280_get_profile(profile);
+
+	if(preset == NULL)
+	{
+		return;
+	}
+
+	bme280_config_t config = *preset;
+	config.mode = mode;
+	bme280_apply_config(dev, &config);
+}
+
+/*---------------------------------------------------*/
+/*
+ @brief: Maximum conversion time of a configuration
+ @param: config: Sensor settings
+ @return: Conversion time in us
+ @Reference: BME280 datasheet section 9.1
+-------------------------------------------------*/
+uint32_t bme280_config_conversion_time_us(const bme280_config_t* config)
+{
+	return conversion_time_us(check_sample_value(config->osrs_t), check_sample_value(config->osrs_p),
+							  check_sample_value(config->osrs_h), T_MEAS_MAX_US);
+}
+
+/*---------------------------------------------------*/
+/*
+ @brief: Estimate average supply current of a configuration. Charge taken by
+ 	 	 one typical conversion is spread over the sampling period, plus the
+ 	 	 idle current for the rest of it.
+ @param: config: Sensor settings
+ 	 	 period_us: Time between two forced conversions. Ignored in normal
+ 	 	 	 	 	mode, where the period is conversion time plus standby time.
+ @return: Average current in nA
+ @Reference: BME280 datasheet section 9.2
+-------------------------------------------------*/
+uint32_t bme280_config_average_current_nA(const bme280_config_t* config, uint32_t period_us)
 {
+	uint8_t osrs_t = check_sample_value(config->osrs_t);
+	uint8_t osrs_p = check_sample_value(config->osrs_p);
+	uint8_t osrs_h = check_sample_value(config->osrs_h);
+	uint32_t idle_nA = IDD_SLEEP_NA;
+
+	//Charge in nA*us, startup overhead is spent at temperature measurement current
+	uint64_t charge = (uint64_t)IDD_T_NA * (t_meas_typ.base_us + t_meas_typ.per_sample_us * oversample_count(osrs_t));
+	if(osrs_p)
+	{
+		charge += (uint64_t)IDD_P_NA * (t_meas_typ.per_sample_us * oversample_count(osrs_p) + t_meas_typ.startup_us);
+	}
+	if(osrs_h)
+	{
+		charge += (uint64_t)IDD_H_NA * (t_meas_typ.per_sample_us * oversample_count(osrs_h) + t_meas_typ.startup_us);
+	}
 
-	// Returns humidity in %RH as unsigned 32 bit integer in Q22. 10 format (22 integer and 10 fractional bits).
-	// Output value of “47445” represents 47445/1024 = 46. 333 %RH
-    uint8_t buffer[2];
-	SPI_read_register(BME280_HUMIDITY_MSB_REG, &buffer[0]);
-	SPI_read_register(BME280_HUMIDITY_LSB_REG, &buffer[1]);
+	if(config->mode == MODE_NORMAL)
+	{
+		period_us = conversion_time_us(osrs_t, osrs_p, osrs_h, T_MEAS_TYP_US) + standby_time_us[config->standby & 0x07];
+		idle_nA = IDD_STANDBY_NA;
+	}
 
-    int32_t adc_H = ((uint32_t)buffer[0] << 8) | ((uint32_t)buffer[1]);
+	if(period_us == 0)
+	{
+		return 0;
+	}
 
-	int32_t var1;
-	var1 = (t_fine - ((int32_t)76800));
+	return (uint32_t)(charge / period_us) + idle_nA;
+}
 
+/*---------------------------------------------------*/
+/*
+ @brief: Check whether a profile run in forced mode once per period converts
+ 	 	 within the period and stays within the current budget
+ @param: profile: Profile to check
+ 	 	 period_us: Time between two forced conversions
+ 	 	 budget_nA: Maximum average supply current allowed
+ @return: 1 if it fits, 0 otherwise or for an invalid profile
+ @Reference:
+-------------------------------------------------*/
+uint8_t bme280_profile_fits(bme280_profile_e profile, uint32_t period_us, uint32_t budget_nA)
+{
+	const bme280_config_t* preset = bme280_get_profile(profile);
 
-	uint8_t H1 = 0;
-	SPI_read_register(BME280_DIG_H1_REG, &H1);
+	if(preset == NULL)
+	{
+		return 0;
+	}
 
-	uint16_t H2_MSB = 0;
-	uint16_t H2_LSB = 0;
-	uint16_t H2 = 0;
-	SPI_read_register(BME280_DIG_H2_MSB_REG, (uint8_t*)&H2_MSB);
-	SPI_read_register(BME280_DIG_H2_LSB_REG, (uint8_t*)&H2_LSB);
-	H2 = (H2_MSB << 8) | (H2_LSB);
+	bme280_config_t config = *preset;
+	config.mode = MODE_FORCED;
 
-	uint8_t H3 = 0;
-	SPI_read_register(BME280_DIG_H3_REG, &H3);
+	return (bme280_config_conversion_time_us(&config) < period_us &&
+			bme280_config_average_current_nA(&config, period_us) <= budget_nA) ? 1 : 0;
+}
 
-	uint16_t H4_MSB = 0;
-	uint16_t H4_LSB = 0;
-	uint16_t H4 = 0;
-	SPI_read_register(BME280_DIG_H4_MSB_REG, (uint8_t*)&H4_MSB);
-	SPI_read_register(BME280_DIG_H4_LSB_REG, (uint8_t*)&H4_LSB);
-	H4 = (H4_MSB << 4) | (H4_LSB & 0x0F);
+/*---------------------------------------------------*/
+/*
+ @brief: Choose the profile to run. The profile of the intended use case is
+ 	 	 kept if it fits the sampling period and current budget. Otherwise the
+ 	 	 fitting profile with the lowest current that still measures the same
+ 	 	 quantities is used. More oversampling is never picked on its own,
+ 	 	 e.g. indoor navigation lags pressure changes by minutes through its IIR filter.
+ @param: preferred: Profile of the use case, BME280_PROFILE_WEATHER_MONITORING
+ 	 	 	 	 	for a weather station (datasheet section 3.5.1)
+ 	 	 period_us: Time between two forced conversions
+ 	 	 budget_nA: Maximum average supply current allowed
+ @return: Selected profile, preferred if nothing fits
+ @Reference: BME280 datasheet section 3.5
+-------------------------------------------------*/
+bme280_profile_e bme280_select_profile(bme280_profile_e preferred, uint32_t period_us, uint32_t budget_nA)
+{
+	const bme280_config_t* wanted = bme280_get_profile(preferred);
+	bme280_profile_e selected = preferred;
+	uint32_t lowest_nA = UINT32_MAX;
 
-	uint16_t H5_MSB = 0;
-	uint16_t H5_LSB = 0;
-	uint16_t H5 = 0;
-	SPI_read_register(BME280_DIG_H5_MSB_REG, (uint8_t*)&H5_MSB);
-	SPI_read_register(BME280_DIG_H4_LSB_REG, (uint8_t*)&H5_LSB);
-	H5 = (H5_MSB << 4) | ((H5_LSB >> 4) & 0x0F);
+	if(wanted == NULL || bme280_profile_fits(preferred, period_us, budget_nA))
+	{
+		return preferred;
+	}
 
-	uint8_t H6 = 0;
-	SPI_read_register(BME280_DIG_H6_REG, &H6);
+	for(bme280_profile_e profile = 0; profile < BME280_NUM_PROFILES; profile++)
+	{
+		bme280_config_t config = profiles[profile];
+		config.mode = MODE_FORCED;
+
+		if((wanted->osrs_t && !config.osrs_t) || (wanted->osrs_p && !config.osrs_p) || (wanted->osrs_h && !config.osrs_h))
+		{
+			continue; //Would stop measuring something the use case needs
+		}
+
+		uint32_t current_nA = bme280_config_average_current_nA(&config, period_us);
+		if(bme280_profile_fits(profile, period_us, budget_nA) && current_nA < lowest_nA)
+		{
+			lowest_nA = current_nA;
+			selected = profile;
+		}
+	}
 
+	return selected;
+}
 
+/*---------------------------------------------------*/
+/*
+ @brief: Unpack the 20 bit pressure and temperature and 16 bit humidity ADC values
+ @param: buffer: Contents of registers 0xF7 to 0xFE
+ 	 	 raw: Pointer to structure in which raw ADC values are stored
+ @return:None.
+ @Reference: BME280 datasheet section 5.4.7 to 5.4.9
+-------------------------------------------------*/
+static void decode_raw(const uint8_t* buffer, bme280_raw_t* raw)
+{
+	raw->adc_P = ((uint32_t)buffer[0] << 12) | ((uint32_t)buffer[1] << 4) | ((buffer[2] >> 4) & 0x0F);
+	raw->adc_T = ((uint32_t)buffer[3] << 12) | ((uint32_t)buffer[4] << 4) | ((buffer[5] >> 4) & 0x0F);
+	raw->adc_H = ((uint32_t)buffer[6] << 8) | ((uint32_t)buffer[7]);
+}
 
-	var1 = (((((adc_H << 14) - (((int32_t)H4) << 20) - (((int32_t)H5) * var1)) +
-	((int32_t)16384)) >> 15) * (((((((var1 * ((int32_t)H6)) >> 10) * (((var1 * ((int32_t)H3)) >> 11) + ((int32_t)32768))) >> 10) + ((int32_t)2097152)) *
-	((int32_t)H2) + 8192) >> 14));
+/*---------------------------------------------------*/
+/*
+ @brief: Read pressure, temperature and humidity ADC values in one burst.
+ 	 	 Datasheet guarantees the data registers are a consistent snapshot
+ 	 	 only when read in a single transaction.
+ @param: dev: Sensor handle
+ 	 	 raw: Pointer to structure in which raw ADC values are stored
+ @return:None.
+ @Reference: BME280 datasheet section 4
+-------------------------------------------------*/
+void bme280_read_raw(const bme280_dev_t* dev, bme280_raw_t* raw)
+{
+	uint8_t buffer[BME280_MEASUREMENTS_LEN];
 
-	var1 = (var1 - (((((var1 >> 15) * (var1 >> 15)) >> 7) * ((int32_t)H1)) >> 4));
-	var1 = (var1 < 0 ? 0 : var1);
-	var1 = (var1 > 419430400 ? 419430400 : var1);
+	SPI_multibyte_read_register(&dev->cs, BME280_MEASUREMENTS_REG, buffer, BME280_MEASUREMENTS_LEN);
 
-	float output = (float)(var1>>12)/1024.0;
-	return output;
+	decode_raw(buffer, raw);
 }
 
 /*---------------------------------------------------*/
 /*
- @brief: Read Pressure value in float
- @param: None.
- @return: Pressure value in Pa
+ @brief: Read raw ADC values of several sensors sharing the SPI bus,
+ 	 	 one burst per sensor back-to-back
+ @param: devs: Array of sensor handles
+ 	 	 raw: Array in which raw ADC values of each sensor are stored
+ 	 	 num_devs: Number of sensors
+ @return:None.
  @Reference:
 -------------------------------------------------*/
-float readFloatPressure( void )
-{
-
-	// Returns pressure in Pa as unsigned 32 bit integer in Q24.8 format (24 integer bits and 8 fractional bits).
-	// Output value of “24674867” represents 24674867/256 = 96386.2 Pa = 963.862 hPa
-    uint8_t buffer[3];
-	SPI_read_register(BME280_PRESSURE_MSB_REG, &buffer[0]);
-	SPI_read_register(BME280_PRESSURE_LSB_REG, &buffer[1]);
-	SPI_read_register(BME280_PRESSURE_XLSB_REG, &buffer[2]);
-
-    int32_t adc_P = ((uint32_t)buffer[0] << 12) | ((uint32_t)buffer[1] << 4) | ((buffer[2] >> 4) & 0x0F);
-
-	int64_t var1, var2, p_acc;
-	var1 = ((int64_t)t_fine) - 128000;
-
-	uint16_t P1_MSB = 0;
-	uint16_t P1_LSB = 0;
-	uint16_t P1 = 0;
-	SPI_read_register(BME280_DIG_P1_MSB_REG, (uint8_t*)&P1_MSB);
-	SPI_read_register(BME280_DIG_P1_LSB_REG, (uint8_t*)&P1_LSB);
-	P1 = (P1_MSB << 8) | (P1_LSB);
-
-	uint16_t P2_MSB = 0;
-	uint16_t P2_LSB = 0;
-	uint16_t P2 = 0;
-	SPI_read_register(BME280_DIG_P2_MSB_REG, (uint8_t*)&P2_MSB);
-	SPI_read_register(BME280_DIG_P2_LSB_REG, (uint8_t*)&P2_LSB);
-	P2 = (P2_MSB << 8) | (P2_LSB);
-
-	uint16_t P3_MSB = 0;
-	uint16_t P3_LSB = 0;
-	uint16_t P3 = 0;
-	SPI_read_register(BME280_DIG_P3_MSB_REG,(uint8_t*)&P3_MSB);
-	SPI_read_register(BME280_DIG_P3_LSB_REG,(uint8_t*)&P3_LSB);
-	P3 = (P3_MSB << 8) | (P3_LSB);
-
-	uint16_t P4_MSB = 0;
-	uint16_t P4_LSB = 0;
-	uint16_t P4 = 0;
-	SPI_read_register(BME280_DIG_P4_MSB_REG,(uint8_t*)&P4_MSB);
-	SPI_read_register(BME280_DIG_P4_LSB_REG,(uint8_t*)&P4_LSB);
-	P4 = (P4_MSB << 8) | (P4_LSB);
-
-	uint16_t P5_MSB = 0;
-	uint16_t P5_LSB = 0;
-	uint16_t P5 = 0;
-	SPI_read_register(BME280_DIG_P5_MSB_REG,(uint8_t*)&P5_MSB);
-	SPI_read_register(BME280_DIG_P5_LSB_REG,(uint8_t*)&P5_LSB);
-	P5 = (P5_MSB << 8) | (P5_LSB);
-
-	uint16_t P6_MSB = 0;
-	uint16_t P6_LSB = 0;
-	uint16_t P6 = 0;
-	SPI_read_register(BME280_DIG_P6_MSB_REG,(uint8_t*)&P6_MSB);
-	SPI_read_register(BME280_DIG_P6_LSB_REG,(uint8_t*)&P6_LSB);
-	P6 = (P6_MSB << 8) | (P6_LSB);
-
-	uint16_t P7_MSB = 0;
-	uint16_t P7_LSB = 0;
-	uint16_t P7 = 0;
-	SPI_read_register(BME280_DIG_P7_MSB_REG,(uint8_t*)&P7_MSB);
-	SPI_read_register(BME280_DIG_P7_LSB_REG,(uint8_t*)&P7_LSB);
-	P7 = (P7_MSB << 8) | (P7_LSB);
-
-	uint16_t P8_MSB = 0;
-	uint16_t P8_LSB = 0;
-	uint16_t P8 = 0;
-	SPI_read_register(BME280_DIG_P8_MSB_REG,(uint8_t*)&P8_MSB);
-	SPI_read_register(BME280_DIG_P8_LSB_REG,(uint8_t*)&P8_LSB);
-	P8 = (P8_MSB << 8) | (P8_LSB);
-
-	uint16_t P9_MSB = 0;
-	uint16_t P9_LSB = 0;
-	uint16_t P9 = 0;
-	SPI_read_register(BME280_DIG_P9_MSB_REG,(uint8_t*)&P9_MSB);
-	SPI_read_register(BME280_DIG_P9_LSB_REG,(uint8_t*)&P9_LSB);
-	P9 = (P9_MSB << 8) | (P9_LSB);
-
-	var2 = var1 * var1 * (int64_t)P6;
-	var2 = var2 + ((var1 * (int64_t)P5)<<17);
-	var2 = var2 + (((int64_t)P4)<<35);
-	var1 = ((var1 * var1 * (int64_t)P3)>>8) + ((var1 * (int64_t)P2)<<12);
-	var1 = (((((int64_t)1)<<47)+var1))*((int64_t)P1)>>33;
-	if (var1 == 0)
+void bme280_read_raw_all(const bme280_dev_t* devs, bme280_raw_t* raw, uint8_t num_devs)
+{
+	for(uint8_t i = 0; i < num_devs; i++)
 	{
-		return 0; // avoid exception caused by division by zero
+		bme280_read_raw(&devs[i], &raw[i]);
 	}
-	p_acc = 1048576 - adc_P;
-	p_acc = (((p_acc<<31) - var2)*3125)/var1;
-	var1 = (((int64_t)P9) * (p_acc>>13) * (p_acc>>13)) >> 25;
-	var2 = (((int64_t)P8) * p_acc) >> 19;
-	p_acc = ((p_acc + var1 + var2) >> 8) + (((int64_t)P7)<<4);
+}
 
-	float output = (float)p_acc / 256.0;
-	return output;
+/*---------------------------------------------------*/
+/*
+ @brief: Read temperature values in celsius.
+ 	 	 Float wrapper around bme280_compensate, needs soft-float on target.
+ @param: dev: Sensor handle
+ 	 	 raw: Raw ADC values read by bme280_read_raw
+ @return:Temperature in DegC.
+ @Reference:
+-------------------------------------------------*/
+float read_temp_C(const bme280_dev_t* dev, const bme280_raw_t* raw)
+{
+	bme280_result_t result;
+	bme280_compensate(raw, &dev->calib, &result);
 
+	return (float)result.temp_val / 100.0f;
 }
 
 /*---------------------------------------------------*/
 /*
- @brief: Read the value of temperature, humidity and pressure
- @param: sensor_val: Pointer to structure that holds temp, humidity and pressure
+ @brief: Read humidity in float
+ 	 	 Float wrapper around bme280_compensate, needs soft-float on target.
+ @param: dev: Sensor handle
+ 	 	 raw: Raw ADC values read by bme280_read_raw
+ @return: humidity value in %RH
+ @Reference:
+-------------------------------------------------*/
+float read_float_humidity(const bme280_dev_t* dev, const bme280_raw_t* raw)
+{
+	bme280_result_t result;
+	bme280_compensate(raw, &dev->calib, &result);
+
+	return (float)result.hum_val / 1024.0f;
+}
+
+/*---------------------------------------------------*/
+/*
+ @brief: Read Pressure value in float
+ 	 	 Float wrapper around bme280_compensate, needs soft-float on target.
+ @param: dev: Sensor handle
+ 	 	 raw: Raw ADC values read by bme280_read_raw
  @return: Pressure value in Pa
  @Reference:
 -------------------------------------------------*/
-void read_sensors(sensor_val_t* sensor_val)
+float readFloatPressure(const bme280_dev_t* dev, const bme280_raw_t* raw)
+{
+	bme280_result_t result;
+	bme280_compensate(raw, &dev->calib, &result);
+
+	return (float)result.pressure_val / 256.0f;
+}
+
+/*---------------------------------------------------*/
+/*
+ @brief: Convert raw values to temperature, humidity and pressure
+ @param: dev: Sensor handle
+ 	 	 raw: Raw ADC values read from the sensor
+ 	 	 sensor_val: Pointer to structure that holds temp, humidity and pressure
+ @return: None.
+ @Reference:
+-------------------------------------------------*/
+static void compensate_sensors(const bme280_dev_t* dev, const bme280_raw_t* raw, sensor_val_t* sensor_val)
 {
-	sensor_val->temp_val = (uint8_t)read_temp_C();
-	if(sensor_val->temp_val < MIN_TEMP && sensor_val->temp_val > MAX_TEMP)
+	bme280_compensate(raw, &dev->calib, sensor_val);
+
+	if(sensor_val->temp_val < MIN_TEMP || sensor_val->temp_val > MAX_TEMP)
 	{
-//		printf("Temperature value outside the valid range\n\r");
+		uint32_t magnitude = (sensor_val->temp_val < 0) ? -(uint32_t)sensor_val->temp_val : (uint32_t)sensor_val->temp_val;
+		printf("Temperature %s%lu.%02lu C outside the valid range\n\r", (sensor_val->temp_val < 0) ? "-" : "",
+			   (unsigned long)(magnitude / 100), (unsigned long)(magnitude % 100));
 	}
 
-	sensor_val->hum_val = (uint8_t)readFloatPressure();
-	if(sensor_val->hum_val < MIN_HUM && sensor_val->hum_val > MAX_HUM)
+	if(sensor_val->pressure_val < MIN_PRES || sensor_val->pressure_val > MAX_PRES)
 	{
-//		printf("Humidity values outside the valid range\n\r");
+		printf("Pressure %lu Pa outside the valid range\n\r", (unsigned long)(sensor_val->pressure_val >> 8));
 	}
 
-	sensor_val->pressure_val = (uint8_t)read_float_humidity();
-	if(sensor_val->pressure_val < MIN_PRES && sensor_val->pressure_val > MAX_PRES)
+	if(sensor_val->hum_val > MAX_HUM)
 	{
-//		printf("Pressure value outside the valid range\n\r");
+		printf("Humidity %lu %%RH outside the valid range\n\r", (unsigned long)(sensor_val->hum_val >> 10));
 	}
 }
 
 /*---------------------------------------------------*/
 /*
- @brief: Transmit values of sensor via UART1
- @param: sensor_val: Pointer to structure that holds temp, humidity and pressure
+ @brief: Read the value of temperature, humidity and pressure
+ @param: dev: Sensor handle
+ 	 	 sensor_val: Pointer to structure that holds temp, humidity and pressure
  @return: None.
  @Reference:
 -------------------------------------------------*/
-void transmit_sensors_val(sensor_val_t* sensor_val)
+void read_sensors(bme280_dev_t* dev, sensor_val_t* sensor_val)
 {
-	__disable_irq();
+	bme280_raw_t raw;
+	bme280_read_raw(dev, &raw); //One coherent snapshot for all three values
 
-	char buffer[200];
+	compensate_sensors(dev, &raw, sensor_val);
+}
 
-	//Send values for temperature
-	char* temp_str[10] = {0};
-	my_itoa(sensor_val->temp_val, (uint8_t*)temp_str);
+/*---------------------------------------------------*/
+/*
+ @brief: Read the value of temperature, humidity and pressure of several
+ 	 	 sensors. All bus transfers are done first, compensation afterwards.
+ @param: devs: Array of sensor handles
+ 	 	 sensor_val: Array of structures that hold temp, humidity and pressure
+ 	 	 num_devs: Number of sensors
+ @return: None.
+ @Reference:
+-------------------------------------------------*/
+void read_sensors_all(bme280_dev_t* devs, sensor_val_t* sensor_val, uint8_t num_devs)
+{
+	bme280_raw_t raw[BME280_MAX_DEVICES];
 
+	if(num_devs > BME280_MAX_DEVICES) num_devs = BME280_MAX_DEVICES; //Error check
 
-	strcat(buffer, "T: ");
-	strcat(buffer, (const char*)temp_str);
-	strcat(buffer, " C \n");
+	bme280_read_raw_all(devs, raw, num_devs);
 
-//
-//	//Send values for pressure
-	char* press_str[10] = {0};
-	my_itoa(sensor_val->pressure_val,(uint8_t*)press_str);
+	for(uint8_t i = 0; i < num_devs; i++)
+	{
+		compensate_sensors(&devs[i], &raw[i], &sensor_val[i]);
+	}
+}
+
+/*---------------------------------------------------*/
+/*
+ @brief: Queue a read of the measurement registers on the SPI bus and return.
+ 	 	 Call bme280_finish_read once the callback has fired.
+ @param: dev: Sensor handle, its burst buffer is written in the background
+ 	 	 callback: Called from interrupt when the burst is done, can be NULL
+ 	 	 ctx: Argument passed to callback
+ @return: Status returned by spi_submit
+ @Reference:
+-------------------------------------------------*/
+spi_status_e bme280_start_read(bme280_dev_t* dev, spi_callback_t callback, void* ctx)
+{
+	//Address once, then clock out the auto-incremented data registers
+	static const uint8_t burst_tx[BME280_BURST_BUF_LEN] =
+	{
+		BME280_MEASUREMENTS_REG, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+	};
 
-	strcat(buffer, "P: ");
-	strcat(buffer,(const char*)press_str);
-	strcat(buffer, " Pa \n");
+	dev->txn.cs = &dev->cs;
+	dev->txn.tx_data = burst_tx;
+	dev->txn.rx_data = dev->burst;
+	dev->txn.length = BME280_BURST_BUF_LEN;
+	dev->txn.callback = callback;
+	dev->txn.ctx = ctx;
 
-//
-//
-//	//Send values for humidity
-	char* hum_str[10] = {0};
-	my_itoa(sensor_val->hum_val,(uint8_t*)hum_str);
-	strcat(buffer, "H: ");
-	strcat(buffer,(const char*)hum_str);
-	strcat(buffer, " %RH \n");
+	return spi_submit(&dev->txn);
+}
+
+/*---------------------------------------------------*/
+/*
+ @brief: Decode the values read by bme280_start_read. Compensation is left to
+ 	 	 the caller, so frames can be queued raw and done in batches with
+ 	 	 bme280_compensate_batch and bme280_get_calibration.
+ @param: dev: Sensor handle
+ 	 	 raw: Raw ADC values of the measurement
+ @return: None.
+ @Reference:
+-------------------------------------------------*/
+void bme280_finish_read(const bme280_dev_t* dev, bme280_raw_t* raw)
+{
+	decode_raw(&dev->burst[1], raw); //First byte was clocked in while sending the address
+}
+
+/*---------------------------------------------------*/
+/*
+ @brief: Append a value with two decimal places to a frame, without float
+ @param: frame: Bluetooth frame to which value is appended
+ 	 	 whole: Integer part
+ 	 	 hundredths: Fractional part, 0 to 99
+ @return: None.
+ @Reference:
+-------------------------------------------------*/
+static void append_fixed_point(uart1_frame_t* frame, uint32_t whole, uint32_t hundredths)
+{
+	uint8_t str[12] = {0};
+
+	my_itoa(whole, str);
+	uart1_frame_puts(frame, (const char*)str);
+
+	str[0] = '.';
+	str[1] = '0' + (hundredths / 10);
+	str[2] = '0' + (hundredths % 10);
+	str[3] = '\0';
+	uart1_frame_puts(frame, (const char*)str);
+}
+
+/*---------------------------------------------------*/
+/*
+ @brief: Transmit values of sensor via UART1. The frame is formatted straight
+ 	 	 into the bluetooth ring, no copy is made.
+ @param: sensor_id: Number of the sensor the values belong to
+ 	 	 sensor_val: Pointer to structure that holds temp, humidity and pressure
+ @return: None.
+ @Reference:
+-------------------------------------------------*/
+void transmit_sensors_val(uint8_t sensor_id, sensor_val_t* sensor_val)
+{
+	uart1_frame_t frame;
+	uint8_t id_str[4] = {0};
+
+	if(!uart1_frame_begin(&frame, SENSOR_FRAME_MAX_LEN))
+	{
+		printf("Frame of sensor %d dropped, bluetooth queue full\n\r", sensor_id);
+		return;
+	}
+
+	//Sensor the values belong to
+	my_itoa(sensor_id, id_str);
+	uart1_frame_puts(&frame, "S: ");
+	uart1_frame_puts(&frame, (const char*)id_str);
+	uart1_frame_puts(&frame, " \n");
+
+	//Send values for temperature
+	int32_t temp = sensor_val->temp_val;
+	uart1_frame_puts(&frame, "T: ");
+	if(temp < 0)
+	{
+		uart1_frame_puts(&frame, "-");
+		temp = -temp;
+	}
+	append_fixed_point(&frame, (uint32_t)temp / 100, (uint32_t)temp % 100);
+	uart1_frame_puts(&frame, " C \n");
 
-	strcat(buffer, "\n***************\n");
-	uart1_puts((uint8_t*)buffer);
-	for(int i = 0; i < 65534 ; i++);
+	//Send values for pressure
+	uart1_frame_puts(&frame, "P: ");
+	append_fixed_point(&frame, sensor_val->pressure_val >> 8, ((sensor_val->pressure_val & 0xFF) * 100) >> 8);
+	uart1_frame_puts(&frame, " Pa \n");
 
-	__enable_irq();
+	//Send values for humidity
+	uart1_frame_puts(&frame, "H: ");
+	append_fixed_point(&frame, sensor_val->hum_val >> 10, ((sensor_val->hum_val & 0x3FF) * 100) >> 10);
+	uart1_frame_puts(&frame, " %RH \n");
 
+	uart1_frame_puts(&frame, "\n***************\n");
+	uart1_frame_end(&frame);
 }
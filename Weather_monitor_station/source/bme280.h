@@ -11,20 +11,58 @@
 //                              Include files
 //***********************************************************************************
 #include <stdint.h>
+#include "spi.h"
+#include "bme280_compensate.h"
 //***********************************************************************************
 //                                  Macros
 //***********************************************************************************
+typedef bme280_result_t sensor_val_t; //Compensated values of one sample
+
+//Sensor settings programmed by bme280_apply_config
+typedef struct
+{
+	uint8_t osrs_t; //Temperature oversampling: 0(skipped), 1, 2, 4, 8, 16
+	uint8_t osrs_p; //Pressure oversampling
+	uint8_t osrs_h; //Humidity oversampling
+	uint8_t filter; //IIR filter register value
+	uint8_t standby; //Standby time register value
+	uint8_t mode; //MODE_SLEEP, MODE_FORCED or MODE_NORMAL
+}bme280_config_t;
+
+//Recommended settings for typical use cases (datasheet section 3.5)
+typedef enum
+{
+	BME280_PROFILE_WEATHER_MONITORING = 0,
+	BME280_PROFILE_HUMIDITY_SENSING = 1,
+	BME280_PROFILE_INDOOR_NAVIGATION = 2,
+	BME280_PROFILE_GAMING = 3,
+	BME280_NUM_PROFILES = 4
+}bme280_profile_e;
+
+#define BME280_BURST_BUF_LEN	(9) //Address byte followed by 0xF7 to 0xFE
+
+//Handle of one sensor on the SPI bus
 typedef struct
 {
-	uint8_t temp_val;
-	uint8_t pressure_val;
-	uint8_t hum_val;
-}sensor_val_t;
+	spi_cs_t cs; //Chip select of this sensor
+	bme280_calib_t calib; //Trimming parameters, loaded once in bme280_init
+	//Write-through copies of the control registers, so settings can be changed
+	//without reading them back over SPI first. Refreshed by bme280_resync.
+	uint8_t reg_ctrl_hum; //0xF2
+	uint8_t reg_ctrl_meas; //0xF4
+	uint8_t reg_config; //0xF5
+	spi_txn_t txn; //Queued bus transaction of bme280_start_read
+	uint8_t burst[BME280_BURST_BUF_LEN]; //Filled in the background by bme280_start_read
+}bme280_dev_t;
 
 #define MODE_SLEEP 0b00
 #define MODE_FORCED 0b01
 #define MODE_NORMAL 0b11
 
+#define BME280_MAX_DEVICES		(4) //Sensors that can share the SPI bus
+
+#define BME280_STAT_MEASURING_MASK		(1 << 3) //Set while conversion is running
+
 //Register names:
 #define BME280_DIG_T1_LSB_REG			0x88
 #define BME280_DIG_T1_MSB_REG			0x89
@@ -75,22 +113,44 @@ typedef struct
 #define BME280_HUMIDITY_LSB_REG			0xFE //Humidity LSB
 
 #define CHIP_REV 						0x60
+
+#define BME280_MEASUREMENTS_LEN			(BME280_HUMIDITY_LSB_REG - BME280_MEASUREMENTS_REG + 1) //0xF7 to 0xFE
+#define BME280_CALIB_TP_LEN				(BME280_DIG_H1_REG - BME280_DIG_T1_LSB_REG + 1) //0x88 to 0xA1
+#define BME280_CALIB_H_LEN				(BME280_DIG_H6_REG - BME280_DIG_H2_LSB_REG + 1) //0xE1 to 0xE7
 //***********************************************************************************
 //                                  Function Prototype
 //***********************************************************************************
-uint8_t bme280_init();
-void set_standby_time(uint8_t timeSetting);
-void set_filter(uint8_t filter_setting);
-void set_temp_oversample(uint8_t over_sample_amount);
+uint8_t bme280_init(bme280_dev_t* dev);
+void bme280_apply_config(bme280_dev_t* dev, const bme280_config_t* config);
+void bme280_resync(bme280_dev_t* dev);
+void bme280_read_calibration(const bme280_dev_t* dev, bme280_calib_t* calib);
+const bme280_calib_t* bme280_get_calibration(const bme280_dev_t* dev);
+void set_standby_time(bme280_dev_t* dev, uint8_t timeSetting);
+void set_filter(bme280_dev_t* dev, uint8_t filter_setting);
+void set_temp_oversample(bme280_dev_t* dev, uint8_t over_sample_amount);
 uint8_t check_sample_value(uint8_t user_value);
-uint8_t get_mode();
-void set_mode(uint8_t mode);
-void set_pressure_oversample(uint8_t over_sample_amount);
-void set_humidity_oversample(uint8_t over_sample_amount);
-void read_sensors(sensor_val_t* sensor_val);
-void transmit_sensors_val(sensor_val_t* sensor_val);
+uint8_t get_mode(const bme280_dev_t* dev);
+void set_mode(bme280_dev_t* dev, uint8_t mode);
+void set_pressure_oversample(bme280_dev_t* dev, uint8_t over_sample_amount);
+void set_humidity_oversample(bme280_dev_t* dev, uint8_t over_sample_amount);
+void bme280_read_raw(const bme280_dev_t* dev, bme280_raw_t* raw);
+void bme280_read_raw_all(const bme280_dev_t* devs, bme280_raw_t* raw, uint8_t num_devs);
+uint32_t bme280_measurement_time_us(const bme280_dev_t* dev);
+uint32_t bme280_trigger_forced(bme280_dev_t* dev);
+uint8_t bme280_is_measuring(const bme280_dev_t* dev);
+const bme280_config_t* bme280_get_profile(bme280_profile_e profile);
+void bme280_apply_profile(bme280_dev_t* dev, bme280_profile_e profile, uint8_t mode);
+uint32_t bme280_config_conversion_time_us(const bme280_config_t* config);
+uint32_t bme280_config_average_current_nA(const bme280_config_t* config, uint32_t period_us);
+uint8_t bme280_profile_fits(bme280_profile_e profile, uint32_t period_us, uint32_t budget_nA);
+bme280_profile_e bme280_select_profile(bme280_profile_e preferred, uint32_t period_us, uint32_t budget_nA);
+void read_sensors(bme280_dev_t* dev, sensor_val_t* sensor_val);
+void read_sensors_all(bme280_dev_t* devs, sensor_val_t* sensor_val, uint8_t num_devs);
+spi_status_e bme280_start_read(bme280_dev_t* dev, spi_callback_t callback, void* ctx);
+void bme280_finish_read(const bme280_dev_t* dev, bme280_raw_t* raw);
+void transmit_sensors_val(uint8_t sensor_id, sensor_val_t* sensor_val);
 
-float read_float_humidity( void );
-float read_temp_C( void );
-float readFloatPressure( void );
+float read_float_humidity(const bme280_dev_t* dev, const bme280_raw_t* raw);
+float read_temp_C(const bme280_dev_t* dev, const bme280_raw_t* raw);
+float readFloatPressure(const bme280_dev_t* dev, const bme280_raw_t* raw);
 #endif /* BME280_H_ */
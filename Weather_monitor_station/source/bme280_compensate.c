@@ -0,0 +1,334 @@
+/***********************************************************************************
+* @file bme280_compensate.c
+ * @brief: BME280 compensation formulas. No register access and no global
+ *         state, so this file builds for target and for a Linux host and can
+ *         compensate archived raw frames off-device.
+ * @author Sayali Mule
+ * @date 12/04/2021
+ * @Reference: BME280 datasheet section 4.2.3
+ *
+ *****************************************************************************/
+//***********************************************************************************
+//                              Include files
+//***********************************************************************************
+#include "bme280_compensate.h"
+//***********************************************************************************
+//                                  Macros
+//***********************************************************************************
+//First reciprocal estimate 48/17 - 32/17 * d of a divisor d in [0.5, 1), in Q31
+#define RECIP_EST_OFFSET		(6063483241ULL) //48/17 * 2^31
+#define RECIP_EST_SLOPE			(4042322160ULL) //16/17 * 2^32
+#define RECIP_NEWTON_STEPS		(3) //4, 8, 16 then 32 correct bits
+
+//1 where the CPU divides 64 bit integers in hardware and the / operator is
+//cheaper than the reciprocal. Cortex-M0+ has no divide instruction at all.
+#ifndef BME280_HW_DIV64
+#if defined(__x86_64__) || defined(__aarch64__)
+#define BME280_HW_DIV64			(1)
+#else
+#define BME280_HW_DIV64			(0)
+#endif
+#endif
+
+//Full chunks of the batch are compensated by fixed length loops the compiler
+//can vectorise. Archives are processed on a PC, where the version for the
+//widest vector unit the CPU has is picked at load time: AVX2, SSE4.1 (first
+//with a 32 bit vector multiply) or plain x86-64. There are no hand written
+//intrinsics, the loops are the scalar formulas, so one source stays bit-exact
+//with bme280_compensate and builds unchanged for the Cortex-M0+.
+#if defined(HOST_BUILD) && defined(__x86_64__) && defined(__GNUC__)
+#define BATCH_KERNEL __attribute__((target_clones("avx2", "sse4.1", "default")))
+#else
+#define BATCH_KERNEL
+#endif
+//***********************************************************************************
+//                              Structures
+//***********************************************************************************
+
+
+//***********************************************************************************
+//                                  Function definition
+//***********************************************************************************
+/*---------------------------------------------------*/
+/*
+ @brief: Decode trimming parameters from the raw NVM blocks
+ @param: tp: 26 bytes read from 0x88 to 0xA1
+ 	 	 h: 7 bytes read from 0xE1 to 0xE7
+ 	 	 calib: Pointer to structure in which trimming values are stored
+ @return:None
+ @Reference: BME280 datasheet section 4.2.2
+-------------------------------------------------*/
+void bme280_parse_calibration(const uint8_t* tp, const uint8_t* h, bme280_calib_t* calib)
+{
+	calib->dig_T1 = (uint16_t)((tp[1] << 8) | tp[0]);
+	calib->dig_T2 = (int16_t)((tp[3] << 8) | tp[2]);
+	calib->dig_T3 = (int16_t)((tp[5] << 8) | tp[4]);
+	calib->dig_P1 = (uint16_t)((tp[7] << 8) | tp[6]);
+	calib->dig_P2 = (int16_t)((tp[9] << 8) | tp[8]);
+	calib->dig_P3 = (int16_t)((tp[11] << 8) | tp[10]);
+	calib->dig_P4 = (int16_t)((tp[13] << 8) | tp[12]);
+	calib->dig_P5 = (int16_t)((tp[15] << 8) | tp[14]);
+	calib->dig_P6 = (int16_t)((tp[17] << 8) | tp[16]);
+	calib->dig_P7 = (int16_t)((tp[19] << 8) | tp[18]);
+	calib->dig_P8 = (int16_t)((tp[21] << 8) | tp[20]);
+	calib->dig_P9 = (int16_t)((tp[23] << 8) | tp[22]);
+	calib->dig_H1 = tp[25]; //0xA1, 0xA0 is unused
+
+	calib->dig_H2 = (int16_t)((h[1] << 8) | h[0]);
+	calib->dig_H3 = h[2];
+	calib->dig_H4 = (int16_t)(((int8_t)h[3] << 4) | (h[4] & 0x0F)); //0xE4[11:4], 0xE5[3:0]
+	calib->dig_H5 = (int16_t)(((int8_t)h[5] << 4) | ((h[4] >> 4) & 0x0F)); //0xE6[11:4], 0xE5[7:4]
+	calib->dig_H6 = (int8_t)h[6];
+}
+
+/*---------------------------------------------------*/
+/*
+ @brief: Compensate raw temperature using integer arithmetic only
+ @param: adc_T: 20 bit raw temperature value
+ 	 	 calib: Trimming parameters of the sensor
+ 	 	 t_fine: Fine temperature, needed by pressure and humidity compensation
+ @return: Temperature in 0.01 DegC. Output value of “5123” equals 51.23 DegC.
+ @Reference: BME280 datasheet section 4.2.3
+-------------------------------------------------*/
+static inline int32_t compensate_temp(int32_t adc_T, const bme280_calib_t* calib, int32_t* t_fine)
+{
+	int32_t var1, var2;
+	var1 = ((((adc_T>>3) - ((int32_t)calib->dig_T1<<1))) * ((int32_t)calib->dig_T2)) >> 11;
+	var2 = (((((adc_T>>4) - ((int32_t)calib->dig_T1)) * ((adc_T>>4) - ((int32_t)calib->dig_T1))) >> 12) *
+	((int32_t)calib->dig_T3)) >> 14;
+	*t_fine = var1 + var2;
+
+	return (*t_fine * 5 + 128) >> 8;
+}
+
+/*---------------------------------------------------*/
+/*
+ @brief: Reciprocal of a normalised divisor by Newton-Raphson, using
+ 	 	 multiplications only
+ @param: dn: Divisor shifted left until bit 31 is set
+ @return: Approximately 2^63 / dn, never above it
+-------------------------------------------------*/
+static inline uint64_t reciprocal_q63(uint32_t dn)
+{
+	uint64_t r = RECIP_EST_OFFSET - (((uint64_t)dn * RECIP_EST_SLOPE) >> 32);
+
+	//r' = r * (2 - dn * r) converges from below after the first step
+	for(uint8_t i = 0; i < RECIP_NEWTON_STEPS; i++)
+	{
+		int64_t err = (int64_t)((1ULL << 63) - (uint64_t)dn * r); //Small, so wrapping is harmless
+		r += (uint64_t)(((int64_t)r * (err >> 31)) >> 32);
+	}
+
+	return (r > UINT32_MAX) ? UINT32_MAX : r;
+}
+
+/*---------------------------------------------------*/
+/*
+ @brief: n * recip / 2^(63 - shift) without a 128 bit product
+ @param: n: Dividend below 2^63
+ 	 	 recip: Result of reciprocal_q63, below 2^32
+ 	 	 shift: Normalisation shift of the divisor
+ @return: Quotient estimate, never above the true quotient
+-------------------------------------------------*/
+static inline uint64_t multiply_reciprocal(uint64_t n, uint64_t recip, uint8_t shift)
+{
+	return ((n >> 32) * recip + (((n & UINT32_MAX) * recip) >> 32)) >> (31 - shift);
+}
+
+/*---------------------------------------------------*/
+/*
+ @brief: 64 bit division truncating toward zero, like the / operator.
+ 	 	 Without a hardware divider the library 64 bit division is a bit
+ 	 	 serial loop, so the quotient is taken from a reciprocal and corrected
+ 	 	 with the remainder instead. The result is exact.
+ @param: num: Dividend
+ 	 	 den: Divisor, not 0
+ @return: num / den
+-------------------------------------------------*/
+static inline int64_t divide_s64(int64_t num, int64_t den)
+{
+	uint64_t n = (num < 0) ? -(uint64_t)num : (uint64_t)num;
+	uint64_t d = (den < 0) ? -(uint64_t)den : (uint64_t)den;
+
+	if(BME280_HW_DIV64 || d > UINT32_MAX || (n >> 63))
+	{
+		return num / den; //Divisor range is never left by the pressure formula
+	}
+
+	uint8_t shift = (uint8_t)__builtin_clz((uint32_t)d);
+	uint64_t recip = reciprocal_q63((uint32_t)d << shift);
+
+	//Estimate is off by a few units at most, the second pass leaves 0 or 1
+	uint64_t q = multiply_reciprocal(n, recip, shift);
+	q += multiply_reciprocal(n - q * d, recip, shift);
+	while(n - q * d >= d)
+	{
+		q++;
+	}
+
+	return ((num < 0) != (den < 0)) ? -(int64_t)q : (int64_t)q;
+}
+
+/*---------------------------------------------------*/
+/*
+ @brief: Compensate raw pressure using integer arithmetic only
+ @param: adc_P: 20 bit raw pressure value
+ 	 	 calib: Trimming parameters of the sensor
+ 	 	 t_fine: Fine temperature from compensate_temp
+ @return: Pressure in Pa in Q24.8 format (24 integer bits and 8 fractional bits).
+ 	 	  Output value of “24674867” represents 24674867/256 = 96386.2 Pa = 963.862 hPa
+ @Reference: BME280 datasheet section 4.2.3
+-------------------------------------------------*/
+static inline uint32_t compensate_pressure(int32_t adc_P, const bme280_calib_t* calib, int32_t t_fine)
+{
+	int64_t var1, var2, p_acc;
+	var1 = ((int64_t)t_fine) - 128000;
+
+	var2 = var1 * var1 * (int64_t)calib->dig_P6;
+	var2 = var2 + ((var1 * (int64_t)calib->dig_P5)<<17);
+	var2 = var2 + (((int64_t)calib->dig_P4)<<35);
+	var1 = ((var1 * var1 * (int64_t)calib->dig_P3)>>8) + ((var1 * (int64_t)calib->dig_P2)<<12);
+	var1 = (((((int64_t)1)<<47)+var1))*((int64_t)calib->dig_P1)>>33;
+	if (var1 == 0)
+	{
+		return 0; // avoid exception caused by division by zero
+	}
+	p_acc = 1048576 - adc_P;
+	p_acc = divide_s64(((p_acc<<31) - var2)*3125, var1);
+	var1 = (((int64_t)calib->dig_P9) * (p_acc>>13) * (p_acc>>13)) >> 25;
+	var2 = (((int64_t)calib->dig_P8) * p_acc) >> 19;
+	p_acc = ((p_acc + var1 + var2) >> 8) + (((int64_t)calib->dig_P7)<<4);
+
+	return (uint32_t)p_acc;
+}
+
+/*---------------------------------------------------*/
+/*
+ @brief: Compensate raw humidity using integer arithmetic only
+ @param: adc_H: 16 bit raw humidity value
+ 	 	 calib: Trimming parameters of the sensor
+ 	 	 t_fine: Fine temperature from compensate_temp
+ @return: Humidity in %RH in Q22.10 format (22 integer and 10 fractional bits).
+ 	 	  Output value of “47445” represents 47445/1024 = 46.333 %RH
+ @Reference: BME280 datasheet section 4.2.3
+-------------------------------------------------*/
+static inline uint32_t compensate_humidity(int32_t adc_H, const bme280_calib_t* calib, int32_t t_fine)
+{
+	int32_t var1;
+	var1 = (t_fine - ((int32_t)76800));
+
+	var1 = (((((adc_H << 14) - (((int32_t)calib->dig_H4) << 20) - (((int32_t)calib->dig_H5) * var1)) +
+	((int32_t)16384)) >> 15) * (((((((var1 * ((int32_t)calib->dig_H6)) >> 10) * (((var1 * ((int32_t)calib->dig_H3)) >> 11) + ((int32_t)32768))) >> 10) + ((int32_t)2097152)) *
+	((int32_t)calib->dig_H2) + 8192) >> 14));
+
+	var1 = (var1 - (((((var1 >> 15) * (var1 >> 15)) >> 7) * ((int32_t)calib->dig_H1)) >> 4));
+	var1 = (var1 < 0 ? 0 : var1);
+	var1 = (var1 > 419430400 ? 419430400 : var1);
+
+	return (uint32_t)(var1 >> 12);
+}
+
+/*---------------------------------------------------*/
+/*
+ @brief: Convert one raw frame to temperature, pressure and humidity.
+ 	 	 Depends only on its arguments, so frames can be compensated in any order.
+ @param: raw: Raw ADC values of one measurement
+ 	 	 calib: Trimming parameters of the sensor that took the measurement
+ 	 	 result: Pointer to structure in which compensated values are stored
+ @return:None
+ @Reference: BME280 datasheet section 4.2.3
+-------------------------------------------------*/
+void bme280_compensate(const bme280_raw_t* raw, const bme280_calib_t* calib, bme280_result_t* result)
+{
+	int32_t t_fine = 0;
+
+	result->temp_val = compensate_temp(raw->adc_T, calib, &t_fine);
+	result->pressure_val = compensate_pressure(raw->adc_P, calib, t_fine);
+	result->hum_val = compensate_humidity(raw->adc_H, calib, t_fine);
+}
+
+/*---------------------------------------------------*/
+/*
+ @brief: Temperature of one full chunk. Fixed trip count and restrict
+ 	 	 pointers, so the loop is vectorised without a scalar tail.
+ @param: adc_T: BME280_BATCH_CHUNK raw temperatures
+ 	 	 calib: Trimming parameters
+ 	 	 temp_val: Temperatures in 0.01 DegC
+ 	 	 t_fine: Fine temperatures for pressure and humidity
+ @return:None
+-------------------------------------------------*/
+static inline void temp_chunk(const int32_t* restrict adc_T, const bme280_calib_t* calib,
+							  int32_t* restrict temp_val, int32_t* restrict t_fine)
+{
+	for(size_t i = 0; i < BME280_BATCH_CHUNK; i++)
+	{
+		temp_val[i] = compensate_temp(adc_T[i], calib, &t_fine[i]);
+	}
+}
+
+/*---------------------------------------------------*/
+/*
+ @brief: Humidity of one full chunk, vectorised like temp_chunk
+ @param: adc_H: BME280_BATCH_CHUNK raw humidities
+ 	 	 calib: Trimming parameters
+ 	 	 t_fine: Fine temperatures from temp_chunk
+ 	 	 hum_val: Humidities in %RH Q22.10
+ @return:None
+-------------------------------------------------*/
+static inline void humidity_chunk(const int32_t* restrict adc_H, const bme280_calib_t* calib,
+								  const int32_t* restrict t_fine, uint32_t* restrict hum_val)
+{
+	const bme280_calib_t trim = *calib; //Local copy, so stores to hum_val can't alias it
+
+	for(size_t i = 0; i < BME280_BATCH_CHUNK; i++)
+	{
+		hum_val[i] = compensate_humidity(adc_H[i], &trim, t_fine[i]);
+	}
+}
+
+/*---------------------------------------------------*/
+/*
+ @brief: Compensate many raw frames taken by one sensor, e.g. the samples
+ 	 	 queued while the bluetooth link was busy, or archived history after
+ 	 	 the calibration changed. Full chunks run each quantity in its own
+ 	 	 loop; temperature and humidity are 32 bit and vectorise. Pressure
+ 	 	 needs 64 bit products and a 64 bit division, so its loop stays
+ 	 	 scalar; divide_s64 is the / operator where BME280_HW_DIV64 is 1, as
+ 	 	 on the host, and the reciprocal elsewhere. The last partial chunk is
+ 	 	 done frame by frame. Results are bit-exact with bme280_compensate.
+ @param: raw: Raw ADC values, num_frames entries per array
+ 	 	 calib: Trimming parameters of the sensor that took the measurements
+ 	 	 result: Arrays in which compensated values are stored
+ 	 	 num_frames: Number of frames
+ @return:None
+ @Reference:
+-------------------------------------------------*/
+BATCH_KERNEL
+void bme280_compensate_batch(const bme280_raw_soa_t* raw, const bme280_calib_t* calib, bme280_result_soa_t* result, size_t num_frames)
+{
+	int32_t t_fine[BME280_BATCH_CHUNK];
+	size_t start = 0;
+
+	for(; start + BME280_BATCH_CHUNK <= num_frames; start += BME280_BATCH_CHUNK)
+	{
+		//Temperature first, it provides t_fine for the other two
+		temp_chunk(&raw->adc_T[start], calib, &result->temp_val[start], t_fine);
+		humidity_chunk(&raw->adc_H[start], calib, t_fine, &result->hum_val[start]);
+
+		for(size_t i = 0; i < BME280_BATCH_CHUNK; i++)
+		{
+			result->pressure_val[start + i] = compensate_pressure(raw->adc_P[start + i], calib, t_fine[i]);
+		}
+	}
+
+	for(; start < num_frames; start++)
+	{
+		const bme280_raw_t frame = {.adc_P = raw->adc_P[start], .adc_T = raw->adc_T[start], .adc_H = raw->adc_H[start]};
+		bme280_result_t value;
+
+		bme280_compensate(&frame, calib, &value);
+		result->temp_val[start] = value.temp_val;
+		result->pressure_val[start] = value.pressure_val;
+		result->hum_val[start] = value.hum_val;
+	}
+}
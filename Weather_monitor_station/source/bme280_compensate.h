@@ -0,0 +1,82 @@
+/***********************************************************************************
+* @file bme280_compensate.h
+ * @brief: BME280 compensation formulas, free of any hardware access so they
+ *         can be used on target and on a Linux host alike
+ * @author Sayali Mule
+ * @date 12/04/2021
+ * @Reference: BME280 datasheet section 4.2.3
+ *****************************************************************************/
+#ifndef BME280_COMPENSATE_H_
+#define BME280_COMPENSATE_H_
+//***********************************************************************************
+//                              Include files
+//***********************************************************************************
+#include <stdint.h>
+#include <stddef.h>
+//***********************************************************************************
+//                                  Macros
+//***********************************************************************************
+//Raw ADC values of one measurement, read in a single burst from 0xF7-0xFE
+typedef struct
+{
+	int32_t adc_P; //20 bit
+	int32_t adc_T; //20 bit
+	int32_t adc_H; //16 bit
+}bme280_raw_t;
+
+//Trimming parameters burst-read from 0x88-0xA1 and 0xE1-0xE7 (datasheet table 16)
+typedef struct
+{
+	uint16_t dig_T1;
+	int16_t  dig_T2;
+	int16_t  dig_T3;
+	uint16_t dig_P1;
+	int16_t  dig_P2;
+	int16_t  dig_P3;
+	int16_t  dig_P4;
+	int16_t  dig_P5;
+	int16_t  dig_P6;
+	int16_t  dig_P7;
+	int16_t  dig_P8;
+	int16_t  dig_P9;
+	uint8_t  dig_H1;
+	int16_t  dig_H2;
+	uint8_t  dig_H3;
+	int16_t  dig_H4;
+	int16_t  dig_H5;
+	int8_t   dig_H6;
+}bme280_calib_t;
+
+//Compensated values of one measurement
+typedef struct
+{
+	int32_t temp_val; //0.01 DegC
+	uint32_t pressure_val; //Pa in Q24.8
+	uint32_t hum_val; //%RH in Q22.10
+}bme280_result_t;
+
+//Raw frames stored as structure of arrays, e.g. archived history of a station
+typedef struct
+{
+	const int32_t* adc_P;
+	const int32_t* adc_T;
+	const int32_t* adc_H;
+}bme280_raw_soa_t;
+
+//Compensated values stored as structure of arrays
+typedef struct
+{
+	int32_t* temp_val;
+	uint32_t* pressure_val;
+	uint32_t* hum_val;
+}bme280_result_soa_t;
+
+#define BME280_BATCH_CHUNK		(8) //Frames per pass, one AVX2 vector of int32
+
+//***********************************************************************************
+//                                  Function Prototype
+//***********************************************************************************
+void bme280_parse_calibration(const uint8_t* tp, const uint8_t* h, bme280_calib_t* calib);
+void bme280_compensate(const bme280_raw_t* raw, const bme280_calib_t* calib, bme280_result_t* result);
+void bme280_compensate_batch(const bme280_raw_soa_t* raw, const bme280_calib_t* calib, bme280_result_soa_t* result, size_t num_frames);
+#endif /* BME280_COMPENSATE_H_ */
@@ -16,82 +16,47 @@
 //                              Include files
 //***********************************************************************************
 #include "cbfifo.h"
-#include "MKL25Z4.h"
-#include <stdio.h>
+#include "reg_access.h"
+#include <string.h>
 //***********************************************************************************
 //                                  Macros
 //***********************************************************************************
-//***********************************************************************************
-//                              Structures
-//***********************************************************************************
-
-
-#define NUM_BYTES (256)
-
-
- static uint8_t tx_buffer[NUM_BYTES]; //statically allocated buffer for tx
- static uint8_t rx_buffer[NUM_BYTES]; //statically allocated buffer for rx
-
-
- cb_t cbfifo_handler[MAX_NUM_BUFFER] ; //Handler for circular buffer
-
 //***********************************************************************************
 //                                  Function definition
 //***********************************************************************************
 
-cb_error_status_e create_tx_cb_handle()
-{
-	cb_error_status_e status = 0;
-	status = create_cb_instance(TX_BUFFER,tx_buffer, NUM_BYTES);
-    if(status)
-    {
-  	  //Handle the error
-  	  printf("Error while initialising Tx buffer\n\r");
-    }
-	return status;
-}
-
-cb_error_status_e create_rx_cb_handle()
-{
-	cb_error_status_e status = 0;
-	status = create_cb_instance(RX_BUFFER,rx_buffer, NUM_BYTES);
-    if(status)
-    {
-  	  //Handle the error
-  	  printf("Error while initialising Rx buffer\n\r");
-    }
-	return status;
-}
 /*-----------------------------------------------------------------------------------------------------------------------------*/
 /*
  @brief: To create the circular buffer
- @param: 1)cb_t* cbfifo_handler: Pointer to circular buffer handler
+ @param: 1)cb_t* cb: Ring to initialise, not needed for rings made with CBFIFO_DEFINE
          2)uint8_t* cb_buffer: Pointer to statically allocated circular buffer
-         3)size_t capacity: Capacity of circular buffer
+         3)size_t capacity: Capacity of circular buffer, must be a power of two
  @return: CB_INSTANCE_SUCCESS on success, CB_INSTANCE_ERROR on failure
  */
 /*-----------------------------------------------------------------------------------------------------------------------------*/
 
 
-cb_error_status_e create_cb_instance(buffer_type_e type,uint8_t* cb_buffer, size_t capacity){
+cb_error_status_e create_cb_instance(cb_t* cb,uint8_t* cb_buffer, size_t capacity){
     cb_error_status_e cb_status = CB_INSTANCE_SUCCESS;
 
-    if(type >= MAX_NUM_BUFFER){
+    if(cb == NULL){
     	cb_status = CB_INSTANCE_ERROR;
     }
     else if(cb_buffer == NULL){
     	cb_status = CB_INSTANCE_ERROR;
     }
-    else if(capacity == 0){
-    	cb_status = CB_INSTANCE_ERROR;
+    else if(capacity == 0 || (capacity & (capacity - 1)) != 0){
+    	cb_status = CB_INSTANCE_ERROR; //Mask arithmetic needs a power of two
     }
     else
     {
-		cbfifo_handler[type].buffer = cb_buffer;
-		cbfifo_handler[type].write = cbfifo_handler[type].buffer; //Point to starting location of CB
-		cbfifo_handler[type].read = cbfifo_handler[type].buffer; //Points to start location of CB
-		cbfifo_handler[type].length = 0;
-		cbfifo_handler[type].capacity = capacity;
+		cb->buffer = cb_buffer;
+		cb->head = 0;
+		cb->tail = 0;
+		cb->capacity = capacity;
+		cb->mask = capacity - 1;
+		cb->policy = CB_POLICY_REJECT;
+		memset(&cb->stats, 0, sizeof(cb_stats_t));
 
 		cb_status = CB_INSTANCE_SUCCESS;
     }
@@ -102,192 +67,512 @@ cb_error_status_e create_cb_instance(buffer_type_e type,uint8_t* cb_buffer, size
 
 /*-----------------------------------------------------------------------------------------------------------------------------*/
 /*
- @brief: Check if circular buffer is empty
+ @brief: Check if circular buffer is empty. Exact when called by the consumer,
+         otherwise only a snapshot.
  @param: None
- @return: Returns 1 if empty , 0 if non empty
+ @return: CB_EMPTY if empty, CB_INSTANCE_SUCCESS if non empty
  */
 /*-----------------------------------------------------------------------------------------------------------------------------*/
 
-cb_error_status_e cbfifo_isempty(buffer_type_e type){
-
-	__disable_irq();
+cb_error_status_e cbfifo_isempty(cb_t* cb){
 
 	cb_error_status_e status = CB_INSTANCE_SUCCESS;
 
 	//Validate input
-	if(type >= MAX_NUM_BUFFER)
+	if(cb == NULL)
 		status = CB_INSTANCE_ERROR;
 
-	else if(cbfifo_handler[type].length == 0)
+	else if(cb->head == cb->tail)
         status = CB_EMPTY;
 
-	__enable_irq();
-
     return status;
 }
 
 /*-----------------------------------------------------------------------------------------------------------------------------*/
 /*
- @brief: Check if circular buffer is full
+ @brief: Check if circular buffer is full. Exact when called by the producer,
+         otherwise only a snapshot.
  @param: None
- @return: Returns 1 if empty , 0 if non full
+ @return: CB_FULL if full, CB_INSTANCE_SUCCESS if non full
  */
 /*-----------------------------------------------------------------------------------------------------------------------------*/
-cb_error_status_e cbfifo_isfull(buffer_type_e type){
-
-	__disable_irq();
+cb_error_status_e cbfifo_isfull(cb_t* cb){
 
 	cb_error_status_e status = CB_INSTANCE_SUCCESS;
 
 	//Validate input
-	if(type >= MAX_NUM_BUFFER)
+	if(cb == NULL)
 		status = CB_INSTANCE_ERROR;
 
-	else if(cbfifo_handler[type].length == cbfifo_handler[type].capacity)
+	else if((cb->head - cb->tail) == cb->capacity)
         status =  CB_FULL;
 
-	__enable_irq();
+	return status;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Update producer side counters after new head has been published
+ @param: 1)cb_t *cb: Ring
+         2)size_t head: New head
+         3)size_t nbyte: Bytes added
+ @return: None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static inline void note_enqueued(cb_t* cb, size_t head, size_t nbyte){
+
+	size_t used = head - cb->tail;
+
+	cb->stats.total_bytes += nbyte;
+	if(used > cb->stats.peak)
+		cb->stats.peak = used;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Lock free part of cbfifo_enqueue
+ @param: 1)const void *buf: Byte to be enqueued
+ @return: CB_INSTANCE_SUCCESS, CB_FULL, CB_INSTANCE_ERROR
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+
+static cb_error_status_e enqueue_one(cb_t* cb, const void *buf){
+
+    if(buf == NULL || cb == NULL || cb->buffer == NULL)
+    	return CB_INSTANCE_ERROR;
+
+    size_t head = cb->head;
+
+    if((head - cb->tail) == cb->capacity){
+    	cb->stats.dropped++;
+    	return CB_FULL;
+    }
+
+    cb->buffer[head & cb->mask] = *((const uint8_t*)buf);
+    __DMB(); //Data must be in the buffer before consumer sees the new head
+    cb->head = head + 1;
+    note_enqueued(cb, head + 1, 1);
+
+	return CB_INSTANCE_SUCCESS;
+
+}
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Lock free part of cbfifo_dequeue
+ @param: 1)void *buf: Put dequeued byte into this buffer
+ @return: CB_INSTANCE_SUCCESS, CB_EMPTY, CB_INSTANCE_ERROR
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static cb_error_status_e dequeue_one(cb_t* cb, void *buf){   //*buff is pointing to the recieving buffer
+
+    if(buf == NULL || cb == NULL || cb->buffer == NULL)
+    	return CB_INSTANCE_ERROR;
+
+    size_t tail = cb->tail;
+
+    if(cb->head == tail){
+    	cb->stats.empty_reads++;
+    	return CB_EMPTY;
+    }
+
+    __DMB(); //Read data only after head has been seen
+    *((uint8_t*)buf) = cb->buffer[tail & cb->mask];
+    __DMB(); //Slot must be read before producer can reuse it
+    cb->tail = tail + 1;
+
+	return CB_INSTANCE_SUCCESS;
+}
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Lock free part of cbfifo_enqueue_n. The free space is at most two
+         runs, split at the end of the buffer, so the payload is copied with
+         at most two memcpy.
+ @param: 1)const void *buf: Data to be enqueued
+         2)size_t nbyte: Number of bytes to be enqueued
+ @return: Number of bytes actually enqueued
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static size_t enqueue_span(cb_t* cb, const void *buf, size_t nbyte){
+
+    if(buf == NULL || cb == NULL || cb->buffer == NULL)
+    	return 0;
+
+    size_t head = cb->head;
+    size_t space = cb->capacity - (head - cb->tail);
+
+    if(nbyte > space){
+    	cb->stats.dropped += nbyte - space;
+    	nbyte = space;
+    }
+
+    size_t offset = head & cb->mask;
+    size_t first = cb->capacity - offset; //Contiguous room up to end of buffer
+    if(first > nbyte)
+    	first = nbyte;
+
+    memcpy(&cb->buffer[offset], buf, first);
+    memcpy(cb->buffer, (const uint8_t*)buf + first, nbyte - first); //Wrapped part, may be empty
+
+    __DMB(); //Data must be in the buffer before consumer sees the new head
+    cb->head = head + nbyte;
+    note_enqueued(cb, head + nbyte, nbyte);
+
+	return nbyte;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Lock free part of cbfifo_dequeue_n, copied with at most two memcpy
+ @param: 1)void *buf: Destination for the dequeued data
+         2)size_t nbyte: Maximum number of bytes to be dequeued
+ @return: Number of bytes actually dequeued
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static size_t dequeue_span(cb_t* cb, void *buf, size_t nbyte){
+
+    if(buf == NULL || cb == NULL || cb->buffer == NULL)
+    	return 0;
+
+    size_t tail = cb->tail;
+    size_t used = cb->head - tail;
+
+    if(used == 0){
+    	if(nbyte != 0)
+    		cb->stats.empty_reads++;
+    	return 0;
+    }
+
+    if(nbyte > used)
+    	nbyte = used;
+
+    __DMB(); //Read data only after head has been seen
+
+    size_t offset = tail & cb->mask;
+    size_t first = cb->capacity - offset; //Contiguous data up to end of buffer
+    if(first > nbyte)
+    	first = nbyte;
+
+    memcpy(buf, &cb->buffer[offset], first);
+    memcpy((uint8_t*)buf + first, cb->buffer, nbyte - first); //Wrapped part, may be empty
+
+    __DMB(); //Slots must be read before producer can reuse them
+    cb->tail = tail + nbyte;
+
+	return nbyte;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Drop the oldest bytes so that nbyte more fit. Caller holds the
+         critical section of a CB_POLICY_OVERWRITE ring.
+ @param: 1)cb_t *cb: Ring
+         2)size_t nbyte: Bytes about to be enqueued, at most capacity
+ @return: None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void make_room(cb_t* cb, size_t nbyte){
+
+	size_t used = cb->head - cb->tail;
+
+	if(used + nbyte > cb->capacity){
+		size_t excess = used + nbyte - cb->capacity;
+		cb->tail = cb->tail + excess;
+		cb->stats.overwritten += excess;
+	}
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Enqueue one byte. Producer side only. A CB_POLICY_OVERWRITE ring
+         drops its oldest byte when full instead of refusing the new one.
+ @param: 1)void *buf: Byte to be enqueued
+
+ @return: CB_INSTANCE_SUCCESS, CB_FULL if there is no room, CB_INSTANCE_ERROR
+          on invalid input
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+cb_error_status_e cbfifo_enqueue(cb_t* cb, void *buf){
+
+	if(cb == NULL || cb->policy == CB_POLICY_REJECT)
+		return enqueue_one(cb, buf);
+
+	uint32_t primask = cb_critical_enter();
+	make_room(cb, 1);
+	cb_error_status_e status = enqueue_one(cb, buf);
+	cb_critical_exit(primask);
 
 	return status;
 }
 
 /*-----------------------------------------------------------------------------------------------------------------------------*/
 /*
- @brief: To Enque the circular buffer
- @param: 1)void *buf: Input buffer to be used for enqueing
+ @brief: Dequeue one byte. Consumer side only.
+ @param: 1)void *buf: Put dequeued byte into this buffer
+
+ @return: CB_INSTANCE_SUCCESS, CB_EMPTY if there is nothing to dequeue,
+          CB_INSTANCE_ERROR on invalid input
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+cb_error_status_e cbfifo_dequeue(cb_t* cb, void *buf){
+
+	if(cb == NULL || cb->policy == CB_POLICY_REJECT)
+		return dequeue_one(cb, buf);
+
+	uint32_t primask = cb_critical_enter(); //Producer may move tail under us
+	cb_error_status_e status = dequeue_one(cb, buf);
+	cb_critical_exit(primask);
+
+	return status;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Enqueue up to nbyte bytes in one go. Producer side only.
+         A CB_POLICY_OVERWRITE ring takes all of them, dropping its oldest
+         bytes, and keeps only the last capacity bytes if nbyte is larger.
+ @param: 1)const void *buf: Data to be enqueued
          2)size_t nbyte: Number of bytes to be enqueued
 
- @return: Count of the Enqued data
+ @return: Number of bytes accepted, 0 if full or on invalid input
  */
 /*-----------------------------------------------------------------------------------------------------------------------------*/
+size_t cbfifo_enqueue_n(cb_t* cb, const void *buf, size_t nbyte){
+
+	if(cb == NULL || cb->buffer == NULL || buf == NULL || cb->policy == CB_POLICY_REJECT)
+		return enqueue_span(cb, buf, nbyte);
+
+	size_t skip = (nbyte > cb->capacity) ? (nbyte - cb->capacity) : 0;
 
-cb_error_status_e cbfifo_enqueue(buffer_type_e type, void *buf){
+	uint32_t primask = cb_critical_enter();
+	make_room(cb, nbyte - skip);
+	enqueue_span(cb, (const uint8_t*)buf + skip, nbyte - skip);
+	cb->stats.overwritten += skip;
+	cb_critical_exit(primask);
 
-	__disable_irq();
+	return nbyte;
+}
 
-	cb_error_status_e cb_status = CB_INSTANCE_SUCCESS;
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Dequeue up to nbyte bytes in one go. Consumer side only.
+ @param: 1)void *buf: Destination for the dequeued data
+         2)size_t nbyte: Maximum number of bytes to be dequeued
 
-    if(buf == NULL)
-    	cb_status = CB_INSTANCE_ERROR ;
+ @return: Number of bytes actually dequeued, 0 if empty or on invalid input
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+size_t cbfifo_dequeue_n(cb_t* cb, void *buf, size_t nbyte){
 
-    if(cbfifo_handler[type].read == NULL)
-    	cb_status = CB_INSTANCE_ERROR ;
+	if(cb == NULL || cb->policy == CB_POLICY_REJECT)
+		return dequeue_span(cb, buf, nbyte);
 
-    if(cbfifo_handler[type].write == NULL)
-    	cb_status = CB_INSTANCE_ERROR ;
+	uint32_t primask = cb_critical_enter(); //Producer may move tail under us
+	size_t count = dequeue_span(cb, buf, nbyte);
+	cb_critical_exit(primask);
 
-    if(cbfifo_handler[type].capacity == 0)
-    	cb_status = CB_INSTANCE_ERROR ;
+	return count;
+}
 
-    if(cb_status != CB_INSTANCE_ERROR)
-    {
-		size_t count = 0;
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Split nbyte bytes starting at index into the part before the end of
+         the buffer and the part wrapped to its start
+ @param: 1)cb_t *cb: Ring
+         2)size_t index: Free-running index of first byte
+         3)size_t nbyte: Number of bytes
+         4)cb_span_t *span1, *span2: Resulting spans
+ @return: None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void split_spans(const cb_t* cb, size_t index, size_t nbyte, cb_span_t* span1, cb_span_t* span2){
 
-		//if circular buffer is not full, enqueue data
-		if(cbfifo_isfull(type) != CB_FULL){
+	size_t offset = index & cb->mask;
+	size_t first = cb->capacity - offset;
+	if(first > nbyte)
+		first = nbyte;
 
-			*(cbfifo_handler[type].write) = *((uint8_t*)buf);
+	span1->data = &cb->buffer[offset];
+	span1->length = first;
+	span2->data = cb->buffer;
+	span2->length = nbyte - first;
+}
 
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Reserve free space for the producer to write in place. Producer side only.
+ @param: 1)size_t nbyte: Bytes wanted
+         2)cb_span_t *span1, *span2: Reserved space, span2 is empty unless it wraps
 
-			cbfifo_handler[type].length = cbfifo_handler[type].length + 1;
+ @return: Bytes reserved, 0 if full or on invalid input
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+size_t cbfifo_reserve(cb_t* cb, size_t nbyte, cb_span_t *span1, cb_span_t *span2){
 
-			//Wrap around to start if write pointer reachers end of buffer
-			if(cbfifo_handler[type].write == cbfifo_handler[type].buffer + cbfifo_handler[type].capacity - 1){
-				cbfifo_handler[type].write = cbfifo_handler[type].buffer;
-			}
-			else{
-				cbfifo_handler[type].write = cbfifo_handler[type].write + 1;
-			}
-			count = count + 1;
+    if(span1 == NULL || span2 == NULL || cb == NULL || cb->buffer == NULL)
+    	return 0;
 
-		}
-		else{
-			//if buffer is full, break from for loop
-			cb_status = CB_FULL; ;
+    size_t head = cb->head;
+    size_t space = cb->capacity - (head - cb->tail);
 
-		}
-    }
-	__enable_irq();
+    if(nbyte > space)
+    	nbyte = space;
 
-	return cb_status;
+    split_spans(cb, head, nbyte, span1, span2);
 
+	return nbyte;
 }
+
 /*-----------------------------------------------------------------------------------------------------------------------------*/
 /*
- @brief: To Deque the circular buffer
- @param: 1)void *buf: Put dequeued data into this buffer
-         2)size_t nbyte: Number of bytes to be dequeued
+ @brief: Publish bytes written into reserved space. Producer side only.
+ @param: 1)size_t nbyte: Bytes written
 
- @return: Returns Count of the Dequed data
+ @return: CB_INSTANCE_SUCCESS, CB_INSTANCE_ERROR on invalid input
  */
 /*-----------------------------------------------------------------------------------------------------------------------------*/
-cb_error_status_e cbfifo_dequeue(buffer_type_e type, void *buf){   //*buff is pointing to the recieving buffer
+cb_error_status_e cbfifo_commit(cb_t* cb, size_t nbyte){
 
-	__disable_irq();
+    if(cb == NULL || cb->buffer == NULL)
+    	return CB_INSTANCE_ERROR;
 
-	cb_error_status_e cb_status = CB_INSTANCE_SUCCESS;
+    size_t head = cb->head;
 
-	//input validate
-    if(buf == NULL){
-        cb_status = CB_INSTANCE_ERROR;
-    }
-    if(cbfifo_handler[type].read == NULL)
-        cb_status = CB_INSTANCE_ERROR;
-    if(cbfifo_handler[type].write == NULL)
-        cb_status = CB_INSTANCE_ERROR;
-    if(cbfifo_handler[type].capacity == 0)
-        cb_status = CB_INSTANCE_ERROR;
-
-    size_t count = 0;
-    if(cb_status != CB_INSTANCE_ERROR)
-    {
-		//if CB is not empty
-		if(cbfifo_isempty(type) != CB_EMPTY){
-
-			*((uint8_t*)buf) = *(cbfifo_handler[type].read); //Read data from read pointer
-			*(cbfifo_handler[type].read) = 0;
-			cbfifo_handler[type].length = cbfifo_handler[type].length - 1;
-			if(cbfifo_handler[type].read == (cbfifo_handler[type].buffer + cbfifo_handler[type].capacity - 1)){
-				cbfifo_handler[type].read = cbfifo_handler[type].buffer;
-			}
-			else{
-				cbfifo_handler[type].read = cbfifo_handler[type].read + 1;
-			}
-			count = count + 1;
-
-		}
-		else{
-			//if CB is empty
-			cb_status = CB_EMPTY;
-		}
+    if(nbyte > cb->capacity - (head - cb->tail))
+    	return CB_INSTANCE_ERROR;
+
+    __DMB(); //Data must be in the buffer before consumer sees the new head
+    cb->head = head + nbyte;
+    note_enqueued(cb, head + nbyte, nbyte);
+
+	return CB_INSTANCE_SUCCESS;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Look at queued data in place. Consumer side only.
+ @param: 1)cb_span_t *span1, *span2: Queued data, span2 is empty unless it wraps
+
+ @return: Bytes available, 0 if empty or on invalid input
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+size_t cbfifo_peek(cb_t* cb, cb_span_t *span1, cb_span_t *span2){
+
+    if(span1 == NULL || span2 == NULL || cb == NULL || cb->buffer == NULL)
+    	return 0;
+
+    size_t tail = cb->tail;
+    size_t used = cb->head - tail;
+
+    __DMB(); //Read data only after head has been seen
+    split_spans(cb, tail, used, span1, span2);
+
+	return used;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Drop data consumed in place. Consumer side only.
+ @param: 1)size_t nbyte: Bytes consumed
+
+ @return: CB_INSTANCE_SUCCESS, CB_INSTANCE_ERROR on invalid input
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+cb_error_status_e cbfifo_release(cb_t* cb, size_t nbyte){
+
+    if(cb == NULL || cb->buffer == NULL)
+    	return CB_INSTANCE_ERROR;
+
+    size_t tail = cb->tail;
+
+    if(nbyte > cb->head - tail)
+    	return CB_INSTANCE_ERROR;
+
+    __DMB(); //Slots must be read before producer can reuse them
+    cb->tail = tail + nbyte;
+
+	return CB_INSTANCE_SUCCESS;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Drop the oldest data from the producer side, e.g. whole records of
+         a ring holding variable length records. CB_POLICY_OVERWRITE only.
+ @param: 1)size_t nbyte: Bytes to drop
+
+ @return: CB_INSTANCE_SUCCESS, CB_INSTANCE_ERROR on invalid input or if
+          nbyte is more than the queued data
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+cb_error_status_e cbfifo_drop(cb_t* cb, size_t nbyte){
+
+    if(cb == NULL || cb->buffer == NULL || cb->policy != CB_POLICY_OVERWRITE)
+    	return CB_INSTANCE_ERROR;
+
+    cb_error_status_e status = CB_INSTANCE_ERROR;
+    uint32_t primask = cb_critical_enter(); //Consumer moves tail too
+
+    if(nbyte <= cb->head - cb->tail){
+    	cb->tail = cb->tail + nbyte;
+    	cb->stats.overwritten += nbyte;
+    	status = CB_INSTANCE_SUCCESS;
     }
-	__enable_irq();
 
-	return cb_status;
+    cb_critical_exit(primask);
+
+	return status;
 }
+
 /*-----------------------------------------------------------------------------------------------------------------------------*/
 /*
- @brief: To get the length of the enqued data in circukar buffer
- @param: None
- @return:Returns number of Enqued data
+ @brief: Drop bytes behind the first offset ones, moving newer data down over
+         them. CB_POLICY_OVERWRITE only.
+ @param: 1)size_t offset: Queued bytes kept in front
+         2)size_t nbyte: Bytes to drop
+
+ @return: CB_INSTANCE_SUCCESS, CB_INSTANCE_ERROR on invalid input or if
+          offset + nbyte is more than the queued data
  */
 /*-----------------------------------------------------------------------------------------------------------------------------*/
-size_t cbfifo_length(buffer_type_e type){
+cb_error_status_e cbfifo_drop_at(cb_t* cb, size_t offset, size_t nbyte){
 
-	__disable_irq();
+    if(cb == NULL || cb->buffer == NULL || cb->policy != CB_POLICY_OVERWRITE)
+    	return CB_INSTANCE_ERROR;
 
-	size_t status = 0;
+    cb_error_status_e status = CB_INSTANCE_ERROR;
+    uint32_t primask = cb_critical_enter(); //Consumer moves tail too
 
-	if(type >= MAX_NUM_BUFFER)
-		status =  CB_INSTANCE_ERROR;
-	else
-		status = cbfifo_handler[type].length;
+    size_t head = cb->head;
+    size_t tail = cb->tail;
 
-	__enable_irq();
+    if(offset + nbyte <= head - tail){
+    	for(size_t i = tail + offset; i + nbyte != head; i++)
+    		cb->buffer[i & cb->mask] = cb->buffer[(i + nbyte) & cb->mask];
+
+    	cb->head = head - nbyte;
+    	cb->stats.overwritten += nbyte;
+    	status = CB_INSTANCE_SUCCESS;
+    }
+
+    cb_critical_exit(primask);
 
 	return status;
 }
 
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: To get the length of the enqued data in circukar buffer
+ @param: None
+ @return:Returns number of Enqued data
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+size_t cbfifo_length(cb_t* cb){
+
+	if(cb == NULL)
+		return CB_INSTANCE_ERROR;
+
+	return cb->head - cb->tail;
+}
+
 /*-----------------------------------------------------------------------------------------------------------------------------*/
 /*
  @brief: To get capacity of the circular buffer
@@ -296,17 +581,28 @@ size_t cbfifo_length(buffer_type_e type){
  */
 /*-----------------------------------------------------------------------------------------------------------------------------*/
 
-size_t cbfifo_capacity(buffer_type_e type){
+size_t cbfifo_capacity(cb_t* cb){
+
+	if(cb == NULL)
+		return CB_INSTANCE_ERROR;
+
+	return cb->capacity;
+}
 
-	__disable_irq();
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Copy the usage counters of a ring. Counters are updated by the ISR
+         as well, so a copy taken from the main loop can be a few bytes behind.
+ @param: 1)cb_stats_t *stats: Structure in which counters are copied
+ @return: CB_INSTANCE_SUCCESS, CB_INSTANCE_ERROR on invalid input
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+cb_error_status_e cbfifo_get_stats(cb_t* cb, cb_stats_t *stats){
 
-	size_t status = 0;
-	if(type >= MAX_NUM_BUFFER)
-		status =  CB_INSTANCE_ERROR;
-	else
-		status = cbfifo_handler[type].capacity;
+	if(stats == NULL || cb == NULL)
+		return CB_INSTANCE_ERROR;
 
-	__enable_irq();
+	*stats = cb->stats;
 
-	return status;
+	return CB_INSTANCE_SUCCESS;
 }
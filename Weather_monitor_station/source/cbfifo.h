@@ -21,6 +21,7 @@
 //***********************************************************************************
 #include <stdlib.h>  // for size_t
 #include <stdint.h>
+#include "reg_access.h"
 
 //***********************************************************************************
 //                              Macros
@@ -33,37 +34,86 @@ typedef enum
 	CB_EMPTY
 }cb_error_status_e;
 
+//What enqueue does when the ring is full
+typedef enum
+{
+	CB_POLICY_REJECT = 0, //Refuse new data. Lock free, the default.
+	CB_POLICY_OVERWRITE //Drop oldest data to make room. Producer then moves tail
+						//as well, so both sides use a short critical section.
+}cb_policy_e;
+
+//Usage counters of one ring, for sizing buffers from field data.
+//Each counter is written by one side only, like the indices.
+typedef struct{
+    size_t peak; //Highest occupancy seen, producer
+    uint32_t total_bytes; //Bytes enqueued, producer
+    uint32_t dropped; //Bytes refused because ring was full, producer
+    uint32_t empty_reads; //Dequeue calls asking for data that found ring empty, consumer.
+                          //Peek and zero byte dequeues only look and are not counted.
+    uint32_t overwritten; //Old bytes dropped to make room, CB_POLICY_OVERWRITE only
+}cb_stats_t;
+
+//Single producer, single consumer ring. Each index is written by one side
+//only, so one ISR and the main loop can share it without masking interrupts.
+//Indices run freely and are reduced with mask, length is head - tail.
 typedef struct{
     uint8_t *buffer;
-    uint8_t* write;
-    uint8_t* read;
-    size_t length;
-    size_t capacity;
+    volatile size_t head; //Written by producer only
+    volatile size_t tail; //Written by consumer only
+    size_t capacity; //Power of two
+    size_t mask; //capacity - 1
+    cb_policy_e policy;
+    cb_stats_t stats;
 }cb_t;
 
+//Contiguous run of ring memory handed out by reserve and peek
+typedef struct{
+	uint8_t* data;
+	size_t length;
+}cb_span_t;
+
+//Define a ring with its own static storage, capacity fixed at compile time.
+//Use "static CBFIFO_DEFINE(...)" for a ring private to one file, and
+//"extern cb_t name;" in a header to share it.
+#define CBFIFO_DEFINE(name, cap)		CBFIFO_DEFINE_POLICY(name, cap, CB_POLICY_REJECT)
+
+#define CBFIFO_DEFINE_POLICY(name, cap, pol)                                                \
+	static uint8_t name##_storage[(cap) > 0 && ((cap) & ((cap) - 1)) == 0 ? (cap) : -1];    \
+	cb_t name = {.buffer = name##_storage, .capacity = (cap), .mask = (cap) - 1, .policy = (pol)}
+
+//Storage aligned to the capacity, for a DMA channel that reads the ring in
+//place with modulo addressing and so wraps at the end of it by itself
+#define CBFIFO_DEFINE_ALIGNED(name, cap, pol)                                               \
+	static uint8_t name##_storage[(cap) > 0 && ((cap) & ((cap) - 1)) == 0 ? (cap) : -1]     \
+		__attribute__((aligned(cap)));                                                      \
+	cb_t name = {.buffer = name##_storage, .capacity = (cap), .mask = (cap) - 1, .policy = (pol)}
 
-typedef enum{
-	TX_BUFFER = 0,
-	RX_BUFFER = 1,
-	TEST_BUFFER = 2,
-	MAX_NUM_BUFFER = 3
-}buffer_type_e;
 //***********************************************************************************
-//                              Global variables
+//                              Inline functions
 //***********************************************************************************
+//Critical section that can be nested, e.g. entered from an ISR
+static inline uint32_t cb_critical_enter(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	return primask;
+}
 
-extern cb_t cbfifo_handler[MAX_NUM_BUFFER]; //Handler for circular buffer
+static inline void cb_critical_exit(uint32_t primask)
+{
+	__set_PRIMASK(primask);
+}
 
 /*------------------------------------------------------------------------------------------------------------------------------------*/
 /*
- @brief: To create the circular buffer
- @param: 1)buffer_type_e
+ @brief: To create the circular buffer at run time
+ @param: 1)cb_t* cb
          2)uint8_t* cb_buffer
          3)size_t capacity
  @return: CB_INSTANCE_SUCCESS
  */
 /*-----------------------------------------------------------------------------------------------------------------------------*/
-cb_error_status_e create_cb_instance(buffer_type_e type,uint8_t* cb_buffer, size_t capacity);
+cb_error_status_e create_cb_instance(cb_t* cb,uint8_t* cb_buffer, size_t capacity);
 
 /*------------------------------------------------------------------------------------------------------------------------------------*/
  /*
@@ -76,7 +126,7 @@ cb_error_status_e create_cb_instance(buffer_type_e type,uint8_t* cb_buffer, size
  */
 /*-----------------------------------------------------------------------------------------------------------------------------*/
 
-cb_error_status_e cbfifo_enqueue(buffer_type_e type, void *buf);
+cb_error_status_e cbfifo_enqueue(cb_t* cb, void *buf);
 /*------------------------------------------------------------------------------------------------------------------------------------*/
 /*
  @brief:* Attempts to remove ("dequeue") up to nbyte bytes of data from the
@@ -94,7 +144,96 @@ cb_error_status_e cbfifo_enqueue(buffer_type_e type, void *buf);
  */
 /*-----------------------------------------------------------------------------------------------------------------------------*/
 
-cb_error_status_e cbfifo_dequeue(buffer_type_e type, void *buf);
+cb_error_status_e cbfifo_dequeue(cb_t* cb, void *buf);
+/*------------------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Enqueues up to nbyte bytes with at most two memcpy
+ @param: 1)const void *buf - Pointer to the data
+         2)size_t nbyte    - Number of bytes to enqueue
+ @return: Number of bytes actually enqueued, which could be 0
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+size_t cbfifo_enqueue_n(cb_t* cb, const void *buf, size_t nbyte);
+
+/*------------------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Dequeues up to nbyte bytes with at most two memcpy
+ @param: 1)void *buf    - Destination for the dequeued data
+         2)size_t nbyte - Maximum number of bytes to dequeue
+ @return: Number of bytes actually dequeued, which could be 0
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+size_t cbfifo_dequeue_n(cb_t* cb, void *buf, size_t nbyte);
+
+/*------------------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Reserve free space so the producer can write straight into the ring.
+         Space wraps at the end of the buffer, so it is given as two spans,
+         the second one empty when there is no wrap.
+ @param: 1)size_t nbyte     - Bytes wanted
+         2)cb_span_t *span1 - First part of the reserved space
+         3)cb_span_t *span2 - Part wrapped to start of buffer
+ @return: Bytes reserved, less than nbyte if the ring is short of room
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+//Zero-copy calls below are for CB_POLICY_REJECT rings. A CB_POLICY_OVERWRITE
+//ring can use them only if its producer makes room with cbfifo_drop first,
+//and its consumer copies data out inside a critical section.
+size_t cbfifo_reserve(cb_t* cb, size_t nbyte, cb_span_t *span1, cb_span_t *span2);
+
+/*------------------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Publish bytes written into reserved space to the consumer
+ @param: 1)size_t nbyte - Bytes written, not more than were reserved
+ @return: CB_INSTANCE_SUCCESS, CB_INSTANCE_ERROR if nbyte is more than the free space
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+cb_error_status_e cbfifo_commit(cb_t* cb, size_t nbyte);
+
+/*------------------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Look at queued data in place, without removing it
+ @param: 1)cb_span_t *span1 - Oldest data
+         2)cb_span_t *span2 - Data wrapped to start of buffer
+ @return: Bytes available in both spans
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+size_t cbfifo_peek(cb_t* cb, cb_span_t *span1, cb_span_t *span2);
+
+/*------------------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Drop bytes the consumer has finished with after cbfifo_peek
+ @param: 1)size_t nbyte - Bytes consumed
+ @return: CB_INSTANCE_SUCCESS, CB_INSTANCE_ERROR if nbyte is more than the queued data
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+cb_error_status_e cbfifo_release(cb_t* cb, size_t nbyte);
+
+/*------------------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Producer side drop of the oldest data of a CB_POLICY_OVERWRITE ring,
+         counted in stats.overwritten. Lets a ring of variable length records
+         drop whole records instead of the bytes enqueue would overwrite.
+ @param: 1)size_t nbyte - Bytes to drop
+ @return: CB_INSTANCE_SUCCESS, CB_INSTANCE_ERROR if nbyte is more than the queued data
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+cb_error_status_e cbfifo_drop(cb_t* cb, size_t nbyte);
+
+/*------------------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Like cbfifo_drop, but the dropped bytes start offset bytes after the
+         oldest, e.g. behind a record the consumer is still reading in place.
+         Newer data is moved down over them, so this costs a copy of
+         everything queued behind the dropped bytes. The consumer must not
+         read past offset until it returns.
+ @param: 1)size_t offset - Queued bytes kept in front of the dropped ones
+         2)size_t nbyte - Bytes to drop
+ @return: CB_INSTANCE_SUCCESS, CB_INSTANCE_ERROR if offset + nbyte is more than the queued data
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+cb_error_status_e cbfifo_drop_at(cb_t* cb, size_t offset, size_t nbyte);
+
 /*------------------------------------------------------------------------------------------------------------------------------------*/
 /*
  @brief: Returns the number of bytes currently on the FIFO.
@@ -102,7 +241,7 @@ cb_error_status_e cbfifo_dequeue(buffer_type_e type, void *buf);
  @return:Number of bytes currently available to be dequeued from the FIFO
  */
 /*-----------------------------------------------------------------------------------------------------------------------------*/
-size_t cbfifo_length(buffer_type_e type);
+size_t cbfifo_length(cb_t* cb);
 
 /*
  @brief: the FIFO's capacity
@@ -110,11 +249,11 @@ size_t cbfifo_length(buffer_type_e type);
  @return:The capacity, in bytes, for the FIFO
  */
 /*-----------------------------------------------------------------------------------------------------------------------------*/
-size_t cbfifo_capacity(buffer_type_e type);
+size_t cbfifo_capacity(cb_t* cb);
 
-cb_error_status_e create_tx_cb_handle();
-cb_error_status_e create_rx_cb_handle();
-cb_error_status_e cbfifo_isempty(buffer_type_e type);
+cb_error_status_e cbfifo_isempty(cb_t* cb);
+cb_error_status_e cbfifo_isfull(cb_t* cb);
+cb_error_status_e cbfifo_get_stats(cb_t* cb, cb_stats_t *stats);
 
 
 
@@ -0,0 +1,89 @@
+/***********************************************************************************
+* @file   cbfifo_typed.h
+ * @brief:Typed FIFO of fixed size records, generated by a macro.
+ *        Same single producer, single consumer rules as cbfifo, but elements
+ *        are whole records stored in static storage of compile-time capacity.
+ *        Records are copied by structure assignment, so the compiler emits a
+ *        copy sized for the record instead of a byte loop.
+ *
+ *        CBFIFO_TYPED_DEFINE(sample_fifo, sample_t, 8) generates:
+ *        1)sample_fifo_t                           - ring type
+ *        2)sample_fifo_enqueue(q, const sample_t*) - CB_INSTANCE_SUCCESS or CB_FULL
+ *        3)sample_fifo_dequeue(q, sample_t*)       - CB_INSTANCE_SUCCESS or CB_EMPTY
+ *        4)sample_fifo_length(q)                   - records queued
+ *        A zero initialised sample_fifo_t is an empty CB_POLICY_REJECT ring.
+ *        Initialise policy to CB_POLICY_OVERWRITE to keep the newest records
+ *        instead, the number of records dropped is kept in overwritten.
+ * @author Sayali Mule
+ * @date 09/05/2021
+ * @Reference:
+ *
+ *****************************************************************************/
+
+#ifndef _CBFIFO_TYPED_H_
+#define _CBFIFO_TYPED_H_
+
+//***********************************************************************************
+//                              Include files
+//***********************************************************************************
+#include <stddef.h>
+#include "cbfifo.h"
+#include "reg_access.h"
+
+//***********************************************************************************
+//                              Macros
+//***********************************************************************************
+#define CBFIFO_TYPED_DEFINE(name, type, capacity)                                           \
+	typedef char name##_capacity_must_be_power_of_two[                                      \
+		((capacity) > 0 && ((capacity) & ((capacity) - 1)) == 0) ? 1 : -1];                 \
+                                                                                            \
+	typedef struct{                                                                         \
+		type items[capacity];                                                               \
+		volatile size_t head; /*Written by producer only*/                                  \
+		volatile size_t tail; /*Written by consumer, and producer when overwriting*/        \
+		cb_policy_e policy;                                                                 \
+		uint32_t overwritten; /*Records dropped to make room*/                              \
+	}name##_t;                                                                              \
+                                                                                            \
+	static inline cb_error_status_e name##_enqueue(name##_t* q, const type* item){          \
+		uint32_t primask = 0;                                                               \
+		if(q->policy == CB_POLICY_OVERWRITE)                                                \
+			primask = cb_critical_enter();                                                  \
+		size_t head = q->head;                                                              \
+		if((head - q->tail) == (capacity)){                                                 \
+			if(q->policy != CB_POLICY_OVERWRITE)                                            \
+				return CB_FULL;                                                             \
+			q->tail = q->tail + 1; /*Drop oldest record*/                                   \
+			q->overwritten++;                                                               \
+		}                                                                                   \
+		q->items[head & ((capacity) - 1)] = *item;                                          \
+		__DMB(); /*Record must be stored before consumer sees the new head*/                \
+		q->head = head + 1;                                                                 \
+		if(q->policy == CB_POLICY_OVERWRITE)                                                \
+			cb_critical_exit(primask);                                                      \
+		return CB_INSTANCE_SUCCESS;                                                         \
+	}                                                                                       \
+                                                                                            \
+	static inline cb_error_status_e name##_dequeue(name##_t* q, type* item){                \
+		cb_error_status_e status = CB_EMPTY;                                                \
+		uint32_t primask = 0;                                                               \
+		if(q->policy == CB_POLICY_OVERWRITE)                                                \
+			primask = cb_critical_enter(); /*Producer may move tail under us*/              \
+		size_t tail = q->tail;                                                              \
+		if(q->head != tail){                                                                \
+			__DMB(); /*Read record only after head has been seen*/                          \
+			*item = q->items[tail & ((capacity) - 1)];                                      \
+			__DMB(); /*Record must be read before producer can reuse the slot*/             \
+			q->tail = tail + 1;                                                             \
+			status = CB_INSTANCE_SUCCESS;                                                   \
+		}                                                                                   \
+		if(q->policy == CB_POLICY_OVERWRITE)                                                \
+			cb_critical_exit(primask);                                                      \
+		return status;                                                                      \
+	}                                                                                       \
+                                                                                            \
+	static inline size_t name##_length(const name##_t* q){                                  \
+		return q->head - q->tail;                                                           \
+	}
+
+#endif // _CBFIFO_TYPED_H_
@@ -0,0 +1,176 @@
+/***********************************************************************************
+* @file console.c
+ * @brief:Command line on UART0. Characters received by UART0_IRQHandler are
+ *        collected into a line and the command is run from the main loop.
+ *        Commands:
+ *        1)help  - list commands
+ *        2)trace - dump the SPI transaction trace as CSV
+ *        3)fifo  - print usage counters of the UART rings
+ * @author Sayali Mule
+ * @date 12/04/2021
+ * @Reference:
+ *
+ *****************************************************************************/
+//***********************************************************************************
+//                              Include files
+//***********************************************************************************
+#include <stdio.h>
+#include <string.h>
+#include "cbfifo.h"
+#include "uart.h"
+#include "spi.h"
+#include "console.h"
+
+//***********************************************************************************
+//                                  Macros
+//***********************************************************************************
+
+//***********************************************************************************
+//                              Structures
+//***********************************************************************************
+static char line[CONSOLE_LINE_LEN + 1];
+static uint8_t line_len = 0;
+
+//***********************************************************************************
+//                                  Function definition
+//***********************************************************************************
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: printf drops characters once the UART0 Tx buffer is full, so let it
+ 	 	 drain before printing the next line of a long dump
+ @param: None
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void wait_tx_room()
+{
+	while(cbfifo_length(&uart0_tx_fifo) > cbfifo_capacity(&uart0_tx_fifo) / 2);
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Print the SPI trace, oldest entry first. Parsed by tools/spi_trace_report.py
+ @param: None
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void dump_spi_trace()
+{
+	uint32_t count = spi_trace_count();
+	uint32_t first = (count > SPI_TRACE_LEN) ? (count - SPI_TRACE_LEN) : 0;
+	spi_trace_entry_t entry;
+
+	if(!SPI_TRACE_ENABLE)
+	{
+		printf("SPI trace disabled, build with SPI_TRACE_ENABLE=1\n\r");
+		return;
+	}
+
+	printf("SPI trace begin,%lu\n\r", (unsigned long)count);
+	printf("seq,start_us,cs_low_us,reg,dir,len\n\r");
+	for(uint32_t seq = first; seq < count; seq++)
+	{
+		if(!spi_trace_read(seq, &entry))
+		{
+			continue; //Overwritten while printing
+		}
+
+		wait_tx_room();
+		printf("%lu,%lu,%lu,0x%02X,%c,%u\n\r", (unsigned long)seq, (unsigned long)entry.start_us,
+				(unsigned long)entry.cs_low_us, entry.reg_addr,
+				(entry.dir == SPI_TRACE_READ) ? 'R' : 'W', entry.length);
+	}
+	printf("SPI trace end\n\r");
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Print usage counters of the UART rings
+ @param: None
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void dump_fifo_stats()
+{
+	static const char* const names[] = {"tx", "rx", "bt_tx"};
+	cb_t* const rings[] = {&uart0_tx_fifo, &uart0_rx_fifo, &uart1_tx_fifo};
+	cb_stats_t stats;
+
+	printf("fifo,capacity,peak,total,dropped,empty_reads,overwritten\n\r");
+	for(uint8_t i = 0; i < sizeof(rings) / sizeof(rings[0]); i++)
+	{
+		if(cbfifo_get_stats(rings[i], &stats) != CB_INSTANCE_SUCCESS)
+		{
+			continue;
+		}
+
+		wait_tx_room();
+
+		printf("%s,%u,%u,%lu,%lu,%lu,%lu\n\r", names[i], (unsigned)cbfifo_capacity(rings[i]), (unsigned)stats.peak,
+				(unsigned long)stats.total_bytes, (unsigned long)stats.dropped, (unsigned long)stats.empty_reads,
+				(unsigned long)stats.overwritten);
+	}
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Run one command line
+ @param: cmd: Null terminated command
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void process_command(const char* cmd)
+{
+	if(cmd[0] == '\0')
+	{
+		return;
+	}
+
+	if(strcmp(cmd, "trace") == 0)
+	{
+		dump_spi_trace();
+	}
+	else if(strcmp(cmd, "fifo") == 0)
+	{
+		dump_fifo_stats();
+	}
+	else if(strcmp(cmd, "help") == 0)
+	{
+		printf("help  - list commands\n\r");
+		printf("trace - dump SPI transaction trace\n\r");
+		printf("fifo  - print UART ring usage\n\r");
+	}
+	else
+	{
+		printf("Unknown command: %s\n\r", cmd);
+	}
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Collect received characters and run the command when enter is pressed.
+ 	 	 Called from the main loop, never blocks.
+ @param: None
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+void console_poll()
+{
+	uint8_t ch = 0;
+
+	//Ask only for what is there, an idle loop is not an empty read
+	while(cbfifo_length(&uart0_rx_fifo) != 0 && cbfifo_dequeue(&uart0_rx_fifo, &ch) == CB_INSTANCE_SUCCESS)
+	{
+		if(ch == '\r' || ch == '\n')
+		{
+			line[line_len] = '\0';
+			process_command(line);
+			line_len = 0;
+		}
+		else if(line_len < CONSOLE_LINE_LEN)
+		{
+			line[line_len++] = ch;
+		}
+	}
+}
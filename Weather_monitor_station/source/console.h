@@ -0,0 +1,23 @@
+/***********************************************************************************
+* @file console.h
+ * @brief:Command line on UART0 for debugging in the field
+ * @author Sayali Mule
+ * @date 12/04/2021
+ * @Reference:
+ *****************************************************************************/
+#ifndef CONSOLE_H_
+#define CONSOLE_H_
+//***********************************************************************************
+//                              Include files
+//***********************************************************************************
+
+//***********************************************************************************
+//                                  Macros
+//***********************************************************************************
+#define CONSOLE_LINE_LEN	(32) //Longest command accepted
+
+//***********************************************************************************
+//                                  Function Prototype
+//***********************************************************************************
+void console_poll();
+#endif /* CONSOLE_H_ */
@@ -10,7 +10,7 @@
 //***********************************************************************************
 //                              Include files
 //***********************************************************************************
-#include "MKL25Z4.h"
+#include "reg_access.h"
 #include "gpio.h"
 
 //***********************************************************************************
@@ -44,6 +44,10 @@ void gpio_init()
 	GPIOD->PDDR |= GPIO_PDDR_PDD(1); //Set as output pin
 	gpio_on(SPI_CS_PORT, SPI_CS_PIN); //Make CS default high
 
+	PORTD->PCR[OUTDOOR_CS_PIN] |= PORT_PCR_MUX(1);//PTD5-> CS of second sensor, ALT1 functionality
+	OUTDOOR_CS_PORT->PDDR |= (1 << OUTDOOR_CS_PIN); //Set as output pin
+	gpio_on(OUTDOOR_CS_PORT, OUTDOOR_CS_PIN); //Make CS default high
+
 	SIM->SCGC5 |= SIM_SCGC5_PORTB_MASK;
 	PORTB->PCR[19] |= PORT_PCR_MUX(1);
 	GPIOB->PDDR |= 0x80000; //Set as output pin
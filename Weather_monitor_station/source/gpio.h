@@ -11,13 +11,16 @@
 //                              Include files
 //***********************************************************************************
 #include <stdint.h>
-#include "MKL25Z4.h"
+#include "reg_access.h"
 //***********************************************************************************
 //                                  Macros
 //***********************************************************************************
 #define SPI_CS_PORT	(GPIOD)
 #define SPI_CS_PIN  (0)
 
+#define OUTDOOR_CS_PORT	(GPIOD) //Chip select of second BME280
+#define OUTDOOR_CS_PIN  (5)
+
 #define GREEN_LED_PORT  (GPIOB)
 #define GREEN_LED_PIN   (19)
 
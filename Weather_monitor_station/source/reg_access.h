@@ -0,0 +1,32 @@
+/***********************************************************************************
+* @file reg_access.h
+ * @brief:Peripheral register access for the drivers in source/.
+ *        On target this is MKL25Z4.h, every register access is a direct
+ *        volatile access to the peripheral.
+ *        With HOST_BUILD defined the same driver code is compiled on Linux.
+ *        Register types and bit masks still come from MKL25Z4.h, but the
+ *        peripheral pointers are redirected to RAM backed register files and
+ *        the CMSIS intrinsics to host functions (see sim_peripherals.h).
+ *        DMA_ADDR converts a pointer to the 32 bit bus address written to
+ *        the DMA SAR/DAR registers. Host pointers don't fit in 32 bits, so
+ *        there it hands out a handle the simulated DMA resolves again.
+ * @author Sayali Mule
+ * @date 12/04/2021
+ * @Reference:
+ *****************************************************************************/
+#ifndef REG_ACCESS_H_
+#define REG_ACCESS_H_
+//***********************************************************************************
+//                              Include files
+//***********************************************************************************
+#include "MKL25Z4.h"
+
+#include <stdint.h>
+
+#ifdef HOST_BUILD
+#include "sim_peripherals.h"
+#else
+#define DMA_ADDR(ptr)		((uint32_t)(uintptr_t)(ptr))
+#endif
+
+#endif /* REG_ACCESS_H_ */
@@ -0,0 +1,334 @@
+/***********************************************************************************
+* @file sim_peripherals.c
+ * @brief:Register files of the simulated KL25Z peripherals, only built with
+ *        HOST_BUILD defined. Also provides the fsl_clock function used by
+ *        spi.c, as drivers/ is not part of the host build.
+ * @author Sayali Mule
+ * @date 12/04/2021
+ * @Reference:
+ *
+ *****************************************************************************/
+#ifdef HOST_BUILD
+//***********************************************************************************
+//                              Include files
+//***********************************************************************************
+#include <string.h>
+#include "reg_access.h"
+#include "fsl_clock.h"
+
+//***********************************************************************************
+//                              Global variables
+//***********************************************************************************
+SIM_Type sim_SIM;
+PORT_Type sim_PORTA, sim_PORTB, sim_PORTD, sim_PORTE;
+GPIO_Type sim_GPIOB, sim_GPIOD;
+SPI_Type sim_SPI0;
+UART0_Type sim_UART0;
+UART_Type sim_UART1, sim_UART2;
+DMA_Type sim_DMA0;
+DMAMUX_Type sim_DMAMUX0;
+SysTick_Type sim_SysTick;
+SCB_Type sim_SCB;
+
+uint32_t sim_irq_disabled = 0;
+uint32_t sim_irq_enabled_mask = 0;
+uint8_t sim_irq_priority[32 + 16];
+uint32_t sim_bus_clock_hz = SIM_BUS_CLOCK_HZ;
+void (*sim_spi0_hook)(void) = NULL;
+
+//Pointers behind the handles returned by sim_dma_addr. Handle is slot + 1 in
+//bits 31-24 and an offset in bits 23-0, so the DMA can increment it.
+static const volatile void* dma_handles[SIM_DMA_HANDLES];
+static uint8_t dma_next_handle = 0;
+
+//***********************************************************************************
+//                                  Function definition
+//***********************************************************************************
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Clear every register and put the model in its idle, always ready state
+ @param: None
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+void sim_peripherals_reset()
+{
+	memset(&sim_SIM, 0, sizeof(sim_SIM));
+	memset(&sim_PORTA, 0, sizeof(sim_PORTA));
+	memset(&sim_PORTB, 0, sizeof(sim_PORTB));
+	memset(&sim_PORTD, 0, sizeof(sim_PORTD));
+	memset(&sim_PORTE, 0, sizeof(sim_PORTE));
+	memset(&sim_GPIOB, 0, sizeof(sim_GPIOB));
+	memset(&sim_GPIOD, 0, sizeof(sim_GPIOD));
+	memset(&sim_SPI0, 0, sizeof(sim_SPI0));
+	memset(&sim_UART0, 0, sizeof(sim_UART0));
+	memset(&sim_UART1, 0, sizeof(sim_UART1));
+	memset(&sim_UART2, 0, sizeof(sim_UART2));
+	memset(&sim_DMA0, 0, sizeof(sim_DMA0));
+	memset(&sim_DMAMUX0, 0, sizeof(sim_DMAMUX0));
+	memset(&sim_SysTick, 0, sizeof(sim_SysTick));
+	memset(&sim_SCB, 0, sizeof(sim_SCB));
+	memset(sim_irq_priority, 0, sizeof(sim_irq_priority));
+	sim_irq_disabled = 0;
+	sim_irq_enabled_mask = 0;
+	sim_bus_clock_hz = SIM_BUS_CLOCK_HZ;
+	sim_spi0_hook = NULL;
+	memset((void*)dma_handles, 0, sizeof(dma_handles));
+	dma_next_handle = 0;
+
+	sim_SPI0.S = SPI_S_SPTEF_MASK | SPI_S_SPRF_MASK;
+	sim_UART0.S1 = UART0_S1_TDRE_MASK | UART0_S1_TC_MASK;
+	*(uint8_t*)&sim_UART1.S1 = UART_S1_TDRE_MASK | UART_S1_TC_MASK; //Read-only for drivers
+	*(uint8_t*)&sim_UART2.S1 = UART_S1_TDRE_MASK | UART_S1_TC_MASK;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Stand-in for __disable_irq
+ @param: None
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+void sim_disable_irq()
+{
+	sim_irq_disabled++;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Stand-in for __enable_irq. Like the real one it does not nest.
+ @param: None
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+void sim_enable_irq()
+{
+	sim_irq_disabled = 0;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Stand-in for NVIC_EnableIRQ
+ @param: irq: External interrupt number
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+void sim_nvic_enable_irq(IRQn_Type irq)
+{
+	if(irq >= 0)
+	{
+		sim_irq_enabled_mask |= (1UL << irq);
+	}
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Stand-in for NVIC_DisableIRQ
+ @param: irq: External interrupt number
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+void sim_nvic_disable_irq(IRQn_Type irq)
+{
+	if(irq >= 0)
+	{
+		sim_irq_enabled_mask &= ~(1UL << irq);
+	}
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Stand-in for NVIC_SetPriority
+ @param: irq: Interrupt or core exception number
+ 	 	 priority: Priority, 0 to 3 on Cortex-M0+
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+void sim_nvic_set_priority(IRQn_Type irq, uint32_t priority)
+{
+	if(irq >= -16 && irq < 32)
+	{
+		sim_irq_priority[irq + 16] = (uint8_t)priority;
+	}
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Stand-in for the bus address of a buffer given to the DMA.
+ 	 	 Slots are reused round robin, enough for every channel's source
+ 	 	 and destination to stay valid while it runs.
+ @param: ptr: Buffer or register
+ @return:Handle resolved by sim_dma_ptr
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+uint32_t sim_dma_addr(const volatile void* ptr)
+{
+	for(uint8_t i = 0; i < SIM_DMA_HANDLES; i++)
+	{
+		if(dma_handles[i] == ptr)
+		{
+			return (uint32_t)(i + 1) << 24;
+		}
+	}
+
+	uint8_t slot = dma_next_handle;
+	dma_next_handle = (dma_next_handle + 1) % SIM_DMA_HANDLES;
+	dma_handles[slot] = ptr;
+
+	return (uint32_t)(slot + 1) << 24;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Pointer behind a handle, including the offset the DMA added to it.
+ 	 	 The offset is signed, a modulo wrap can take it below the handle.
+ @param: addr: SAR or DAR value
+ @return:Pointer, NULL if the handle was never handed out
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+volatile void* sim_dma_ptr(uint32_t addr)
+{
+	uint32_t slot = addr >> 24;
+	int32_t offset = (int32_t)(addr << 8) >> 8;
+
+	if(slot == 0 || slot > SIM_DMA_HANDLES || dma_handles[slot - 1] == NULL)
+	{
+		return NULL;
+	}
+
+	return (volatile uint8_t*)dma_handles[slot - 1] + offset;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Address of the next item. With modulo addressing the address wraps
+ 	 	 back to the start of the 8 << mod byte block it is in, which
+ 	 	 is taken from the real pointer behind the handle.
+ @param: addr: SAR or DAR value
+ 	 	 mod: SMOD or DMOD field, 0 for a linear buffer
+ @return:Advanced SAR or DAR value
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static uint32_t dma_advance(uint32_t addr, uint32_t mod)
+{
+	int32_t step = 1;
+
+	if(mod != 0)
+	{
+		uintptr_t size = (uintptr_t)8 << mod;
+		uintptr_t next = (uintptr_t)sim_dma_ptr(addr) + 1;
+
+		if((next & (size - 1)) == 0)
+		{
+			step -= (int32_t)size;
+		}
+	}
+
+	return (addr & 0xFF000000) | ((addr + step) & 0xFFFFFF);
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Serve one request of a DMA channel: move one 8 bit item from SAR to
+ 	 	 DAR, advance the addresses that increment, wrapping them if SMOD or
+ 	 	 DMOD is set, and count BCR down. When
+ 	 	 BCR reaches zero DONE is set, and ERQ is cleared if D_REQ is set.
+ 	 	 An address that was not handed out by DMA_ADDR sets CE and DONE.
+ 	 	 The test calls DMA0_IRQHandler or DMA2_IRQHandler itself if EINT is set.
+ @param: channel: DMA channel 0 to 3
+ @return:1 if an item was moved, 0 if the channel is not running
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+uint8_t sim_dma_step(uint8_t channel)
+{
+	DMA_Type* dma = &sim_DMA0;
+	uint32_t bcr = dma->DMA[channel].DSR_BCR & DMA_DSR_BCR_BCR_MASK;
+	uint32_t dcr = dma->DMA[channel].DCR;
+
+	if(!(dcr & DMA_DCR_ERQ_MASK) || bcr == 0)
+	{
+		return 0;
+	}
+
+	volatile uint8_t* src = sim_dma_ptr(dma->DMA[channel].SAR);
+	volatile uint8_t* dst = sim_dma_ptr(dma->DMA[channel].DAR);
+	if(src == NULL || dst == NULL)
+	{
+		dma->DMA[channel].DSR_BCR |= DMA_DSR_BCR_CE_MASK | DMA_DSR_BCR_DONE_MASK; //Configuration error ends the transfer
+		return 0;
+	}
+
+	*dst = *src;
+	if(dcr & DMA_DCR_SINC_MASK)
+	{
+		dma->DMA[channel].SAR = dma_advance(dma->DMA[channel].SAR, (dcr & DMA_DCR_SMOD_MASK) >> DMA_DCR_SMOD_SHIFT);
+	}
+	if(dcr & DMA_DCR_DINC_MASK)
+	{
+		dma->DMA[channel].DAR = dma_advance(dma->DMA[channel].DAR, (dcr & DMA_DCR_DMOD_MASK) >> DMA_DCR_DMOD_SHIFT);
+	}
+
+	bcr--;
+	dma->DMA[channel].DSR_BCR = DMA_DSR_BCR_BCR(bcr);
+	if(bcr == 0)
+	{
+		dma->DMA[channel].DSR_BCR |= DMA_DSR_BCR_DONE_MASK;
+		if(dcr & DMA_DCR_D_REQ_MASK)
+		{
+			dma->DMA[channel].DCR &= ~DMA_DCR_ERQ_MASK;
+		}
+	}
+
+	return 1;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Serve requests of a DMA channel until it stops
+ @param: channel: DMA channel 0 to 3
+ @return:Number of items moved
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+uint32_t sim_dma_run(uint8_t channel)
+{
+	uint32_t moved = 0;
+
+	while(sim_dma_step(channel))
+	{
+		moved++;
+	}
+
+	return moved;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Register file behind SPI0. The hook sees the register file as the
+ 	 	 previous access left it and can update it before this one.
+ @param: None
+ @return:Register file of SPI0
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+SPI_Type* sim_spi0_access()
+{
+	if(sim_spi0_hook != NULL)
+	{
+		sim_spi0_hook();
+	}
+
+	return &sim_SPI0;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Bus clock of the modelled clock configuration, set by tests
+ @param: None
+ @return:Bus clock in Hz
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+uint32_t CLOCK_GetBusClkFreq(void)
+{
+	return sim_bus_clock_hz;
+}
+#endif
@@ -0,0 +1,113 @@
+/***********************************************************************************
+* @file sim_peripherals.h
+ * @brief:Simulated KL25Z peripherals for HOST_BUILD. Only included through
+ *        reg_access.h, after MKL25Z4.h.
+ *        Every peripheral used by source/ is a plain structure in RAM, so
+ *        drivers read back what they wrote. sim_peripherals_reset puts the
+ *        model in its idle state: SPI0 and the UARTs always report empty
+ *        transmit and full receive registers, so polled loops never stall
+ *        and the cost of the driver code itself can be measured. Tests can
+ *        change any register in between to model other behaviour.
+ *        DMA channels only move data when a test steps them with
+ *        sim_dma_step, standing in for the peripheral requests.
+ *        Every SPI0 register access runs sim_spi0_hook first, so a test
+ *        can put a timing model of the SPI behind the register file.
+ * @author Sayali Mule
+ * @date 12/04/2021
+ * @Reference:
+ *****************************************************************************/
+#ifndef SIM_PERIPHERALS_H_
+#define SIM_PERIPHERALS_H_
+//***********************************************************************************
+//                              Include files
+//***********************************************************************************
+#include <stdint.h>
+
+//***********************************************************************************
+//                                  Macros
+//***********************************************************************************
+#define SIM_DMA_HANDLES			(16) //Buffers that can be programmed into DMA at once
+#define SIM_BUS_CLOCK_HZ		(24000000U) //Bus clock of BOARD_BootClockRUN, default of sim_bus_clock_hz
+
+//Peripheral pointers of MKL25Z4.h and core_cm0plus.h redirected to the model
+#undef SIM
+#undef PORTA
+#undef PORTB
+#undef PORTD
+#undef PORTE
+#undef GPIOB
+#undef GPIOD
+#undef SPI0
+#undef UART0
+#undef UART1
+#undef UART2
+#undef DMA0
+#undef DMAMUX0
+#undef SysTick
+#undef SCB
+
+#define SIM			(&sim_SIM)
+#define PORTA		(&sim_PORTA)
+#define PORTB		(&sim_PORTB)
+#define PORTD		(&sim_PORTD)
+#define PORTE		(&sim_PORTE)
+#define GPIOB		(&sim_GPIOB)
+#define GPIOD		(&sim_GPIOD)
+#define SPI0		(sim_spi0_access())
+#define UART0		(&sim_UART0)
+#define UART1		(&sim_UART1)
+#define UART2		(&sim_UART2)
+#define DMA0		(&sim_DMA0)
+#define DMAMUX0		(&sim_DMAMUX0)
+#define SysTick		(&sim_SysTick)
+#define SCB			(&sim_SCB) //Only ICSR pending bits are used
+
+//CMSIS NVIC functions are inline and were already bound to the real NVIC
+#define NVIC_EnableIRQ(irq)				sim_nvic_enable_irq(irq)
+#define NVIC_DisableIRQ(irq)			sim_nvic_disable_irq(irq)
+#define NVIC_ClearPendingIRQ(irq)		((void)(irq))
+#define NVIC_SetPriority(irq, prio)		sim_nvic_set_priority((irq), (prio))
+
+//Interrupt masking has no meaning without interrupts, count it instead
+#define __disable_irq()		sim_disable_irq()
+#define __enable_irq()		sim_enable_irq()
+#define __get_PRIMASK()		(sim_irq_disabled != 0)
+#define __set_PRIMASK(x)	(sim_irq_disabled = (x))
+#define DMA_ADDR(ptr)		sim_dma_addr((const volatile void*)(ptr))
+#define __DMB()				__atomic_thread_fence(__ATOMIC_SEQ_CST) //Host threads stand in for ISR and main loop
+
+//***********************************************************************************
+//                              Global variables
+//***********************************************************************************
+extern SIM_Type sim_SIM;
+extern PORT_Type sim_PORTA, sim_PORTB, sim_PORTD, sim_PORTE;
+extern GPIO_Type sim_GPIOB, sim_GPIOD;
+extern SPI_Type sim_SPI0;
+extern UART0_Type sim_UART0;
+extern UART_Type sim_UART1, sim_UART2;
+extern DMA_Type sim_DMA0;
+extern DMAMUX_Type sim_DMAMUX0;
+extern SysTick_Type sim_SysTick;
+extern SCB_Type sim_SCB;
+
+extern uint32_t sim_irq_disabled; //Nesting depth of __disable_irq
+extern uint32_t sim_irq_enabled_mask; //Bit per external interrupt enabled in NVIC
+extern uint8_t sim_irq_priority[32 + 16]; //Indexed by IRQn + 16, covers core exceptions
+extern uint32_t sim_bus_clock_hz; //Returned by CLOCK_GetBusClkFreq
+extern void (*sim_spi0_hook)(void); //Run before every SPI0 access, NULL after reset
+
+//***********************************************************************************
+//                                  Function Prototype
+//***********************************************************************************
+void sim_peripherals_reset();
+void sim_disable_irq();
+void sim_enable_irq();
+void sim_nvic_enable_irq(IRQn_Type irq);
+void sim_nvic_disable_irq(IRQn_Type irq);
+void sim_nvic_set_priority(IRQn_Type irq, uint32_t priority);
+uint32_t sim_dma_addr(const volatile void* ptr);
+volatile void* sim_dma_ptr(uint32_t addr);
+uint8_t sim_dma_step(uint8_t channel);
+uint32_t sim_dma_run(uint8_t channel);
+SPI_Type* sim_spi0_access();
+#endif /* SIM_PERIPHERALS_H_ */
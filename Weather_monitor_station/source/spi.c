@@ -9,15 +9,50 @@
 //***********************************************************************************
 //                              Include files
 //***********************************************************************************
-#include "MKL25Z4.h"
+#include "reg_access.h"
 #include "gpio.h"
+#include "spi.h"
+#include "systick.h"
+#include "fsl_clock.h"
 
 //***********************************************************************************
 //                                  Macros
 //***********************************************************************************
+#define SPI_SPPR_MAX			(7) //Prescaler divisor 1 to 8
+#define SPI_SPR_MAX				(8) //Baud rate divisor 2 to 512
+
+#define DMAMUX_SRC_SPI0_RX		(16)
+#define DMAMUX_SRC_SPI0_TX		(17)
+
+//8 bit peripheral and memory accesses, request cleared when byte count reaches zero
+#define SPI_DMA_DCR_COMMON		(DMA_DCR_ERQ_MASK | DMA_DCR_CS_MASK | DMA_DCR_SSIZE(1) | DMA_DCR_DSIZE(1) | DMA_DCR_D_REQ_MASK)
 //***********************************************************************************
 //                              Structures
 //***********************************************************************************
+//State of the transfer owned by the DMA, shared with DMA0_IRQHandler
+static volatile uint8_t dma_busy = 0;
+static const spi_cs_t* dma_cs = NULL;
+static spi_callback_t dma_callback = NULL;
+static void* dma_ctx = NULL;
+
+static const uint8_t dma_tx_idle = 0xFF; //Clocked out when caller has nothing to send
+static uint8_t dma_rx_discard; //Sink for received bytes the caller does not want
+
+//Transaction queue, head is the running transaction. Shared with the interrupts.
+static spi_txn_t* txn_queue[SPI_QUEUE_LEN];
+static volatile uint8_t queue_head = 0;
+static volatile uint8_t queue_count = 0;
+static volatile uint8_t queue_start_pending = 0; //Head is waiting for a direct DMA transfer to release the bus
+#if !SPI_QUEUE_USE_DMA
+static size_t txn_pos = 0; //Bytes of the running transaction received so far
+#endif
+static spi_queue_stats_t queue_stats = {0};
+
+#if SPI_TRACE_ENABLE
+static spi_trace_entry_t trace_ring[SPI_TRACE_LEN];
+static volatile uint32_t trace_seq = 0; //Entries recorded since power up
+static spi_trace_entry_t trace_open; //Cycle in progress, only one CS is low at a time
+#endif
 
 
 
@@ -26,6 +61,46 @@
 //***********************************************************************************
 
 
+/*------------------------------------------------------------------------*/
+/*
+  @brief: Pull chip select low and open a trace entry
+ @param: cs: Chip select of the device
+ 	 	 first_byte: First byte sent, register address on BME280
+ 	 	 length: Bytes clocked during this cycle
+ @return: None
+ */
+/*-----------------------------------------------------------------------*/
+static void cs_select(const spi_cs_t* cs, uint8_t first_byte, size_t length)
+{
+#if SPI_TRACE_ENABLE
+	trace_open.reg_addr = first_byte | 0x80; //SPI uses bit 7 for direction only
+	trace_open.dir = (first_byte & 0x80) ? SPI_TRACE_READ : SPI_TRACE_WRITE;
+	trace_open.length = (length > UINT16_MAX) ? UINT16_MAX : length;
+	trace_open.start_us = get_time_us();
+#else
+	(void)first_byte;
+	(void)length;
+#endif
+	gpio_off(cs->port, cs->pin); //Turn CS low
+}
+
+/*------------------------------------------------------------------------*/
+/*
+  @brief: Pull chip select high and close the trace entry
+ @param: cs: Chip select of the device
+ @return: None
+ */
+/*-----------------------------------------------------------------------*/
+static void cs_release(const spi_cs_t* cs)
+{
+	gpio_on(cs->port, cs->pin); //Turn CS high
+#if SPI_TRACE_ENABLE
+	trace_open.cs_low_us = get_time_us() - trace_open.start_us;
+	trace_ring[trace_seq % SPI_TRACE_LEN] = trace_open;
+	trace_seq++;
+#endif
+}
+
 /*-----------------------------------------------------------------------------------------------------------------------------*/
 /*
  @brief: Initialise SPI peripheral
@@ -59,8 +134,76 @@ void spi_init()
 	SPI0->C1 &= ~(SPI_C1_CPOL_MASK); //Make CPHA 0
 	SPI0->C2 &= ~(SPI_C2_MODFEN_MASK); //Make MODFEN bit to zero
 
-	SPI0->BR = (SPI_BR_SPPR(0x00) | SPI_BR_SPR(0x01)); //SPR(0x01)-> Baud rate divisor = 4, SPPR(0x00)->Prescalar divisor is 1
+	spi_set_frequency(SPI_DEFAULT_FREQ_HZ);
 	SPI0->C1 |= SPI_C1_SPE_MASK; //Enable spi
+
+	SIM->SCGC6 |= SIM_SCGC6_DMAMUX_MASK; //Enable clock to DMA mux
+	SIM->SCGC7 |= SIM_SCGC7_DMA_MASK; //Enable clock to DMA controller
+
+	DMAMUX0->CHCFG[SPI_DMA_RX_CHANNEL] = 0; //Disable channel before changing source
+	DMAMUX0->CHCFG[SPI_DMA_TX_CHANNEL] = 0;
+	DMAMUX0->CHCFG[SPI_DMA_RX_CHANNEL] = DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(DMAMUX_SRC_SPI0_RX);
+	DMAMUX0->CHCFG[SPI_DMA_TX_CHANNEL] = DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(DMAMUX_SRC_SPI0_TX);
+
+	NVIC_SetPriority(DMA0_IRQn, 2);
+	NVIC_ClearPendingIRQ(DMA0_IRQn);
+	NVIC_EnableIRQ(DMA0_IRQn);
+
+	NVIC_SetPriority(SPI0_IRQn, 2); //SPIE is only set while the queue is running
+	NVIC_ClearPendingIRQ(SPI0_IRQn);
+	NVIC_EnableIRQ(SPI0_IRQn);
+}
+
+/*------------------------------------------------------------------------*/
+/*
+  @brief: Blocking helpers own the bus directly, wait for queued transactions
+  	  	  and a direct DMA transfer to finish first so they don't interleave
+  	  	  with them
+ @param: None
+ @return: None
+ */
+/*-----------------------------------------------------------------------*/
+static void wait_queue_idle()
+{
+	while(queue_count != 0 || dma_busy);
+}
+
+/*------------------------------------------------------------------------*/
+/*
+  @brief: Set SCK to the fastest rate not above the requested one. The rate is
+  	  	  bus clock / ((SPPR + 1) * 2^(SPR + 1)), every pair is tried since
+  	  	  several of them give the same divisor.
+ @param: hz: Requested SCK frequency
+ @return: SCK frequency actually achieved. If hz is below the slowest
+ 	 	  possible rate, the slowest rate is used and returned.
+ @Reference: KL25 Sub-Family Reference Manual section 37.3.3
+ */
+/*-----------------------------------------------------------------------*/
+uint32_t spi_set_frequency(uint32_t hz)
+{
+	uint32_t bus_clock = CLOCK_GetBusClkFreq();
+	uint8_t best_sppr = SPI_SPPR_MAX;
+	uint8_t best_spr = SPI_SPR_MAX;
+	uint32_t best_hz = bus_clock / ((SPI_SPPR_MAX + 1) << (SPI_SPR_MAX + 1));
+
+	for(uint8_t spr = 0; spr <= SPI_SPR_MAX; spr++)
+	{
+		for(uint8_t sppr = 0; sppr <= SPI_SPPR_MAX; sppr++)
+		{
+			uint32_t rate = bus_clock / ((uint32_t)(sppr + 1) << (spr + 1));
+			if(rate <= hz && rate > best_hz)
+			{
+				best_hz = rate;
+				best_sppr = sppr;
+				best_spr = spr;
+			}
+		}
+	}
+
+	wait_queue_idle(); //Don't change the clock in the middle of a transaction
+	SPI0->BR = SPI_BR_SPPR(best_sppr) | SPI_BR_SPR(best_spr);
+
+	return best_hz;
 }
 
 /*--------------------------------------------------------------------------------------------------------------------------*/
@@ -105,7 +248,7 @@ void SPI_write_byte(uint8_t data)
 /*-----------------------------------------------------------------------------------------------------------------------------*/
 void SPI_write_multibyte(uint8_t* data, size_t length)
 {
-	for(int i = 0; i < length ;i++)
+	for(size_t i = 0; i < length ;i++)
 	{
 		SPI_write_byte(data[i]);
 	}
@@ -121,88 +264,565 @@ void SPI_write_multibyte(uint8_t* data, size_t length)
 /*-----------------------------------------------------------------------------------------------------------------------------*/
 void SPI_read_multibyte(uint8_t* data, size_t length)
 {
-	for(int i = 0; i < length ; i++)
+	for(size_t i = 0; i < length ; i++)
 	{
 		SPI_read_byte(&data[i]);
 	}
 }
 
+/*------------------------------------------------------------------------*/
+/*
+  @brief: Full duplex streaming of prefix bytes followed by data bytes. The
+  	  	  next byte is loaded into the transmit buffer while the current one
+  	  	  is still shifting, so bytes go out back-to-back. At most two bytes
+  	  	  are in flight, as the receive side has a single data register.
+  	  	  Interrupts are masked because a late read of the received byte
+  	  	  would lose the one behind it. PRIMASK is restored afterwards, so
+  	  	  callers that already masked interrupts keep them masked.
+ @param: prefix: Bytes sent first, whatever is received meanwhile is dropped
+ 	 	 prefix_len: Number of prefix bytes
+ 	 	 tx_data: Data bytes to send, NULL to send 0xFF
+ 	 	 rx_data: Buffer for bytes received during data phase, NULL to discard
+ 	 	 length: Number of data bytes
+ @return: None
+ */
+/*-----------------------------------------------------------------------*/
+static void stream_transfer(const uint8_t* prefix, size_t prefix_len, const uint8_t* tx_data, uint8_t* rx_data, size_t length)
+{
+	size_t total = prefix_len + length;
+	size_t tx_pos = 0;
+	size_t rx_pos = 0;
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq(); //critical section
+	while(rx_pos < total)
+	{
+		uint8_t status = SPI0->S;
+
+		if((status & SPI_S_SPRF_MASK) && rx_pos < tx_pos)
+		{
+			uint8_t data = SPI0->D;
+			if(rx_pos >= prefix_len && rx_data)
+			{
+				rx_data[rx_pos - prefix_len] = data;
+			}
+			rx_pos++;
+		}
+		else if((status & SPI_S_SPTEF_MASK) && tx_pos < total && (tx_pos - rx_pos) < 2)
+		{
+			if(tx_pos < prefix_len)
+			{
+				SPI0->D = prefix[tx_pos];
+			}
+			else
+			{
+				SPI0->D = tx_data ? tx_data[tx_pos - prefix_len] : 0xFF;
+			}
+			tx_pos++;
+		}
+	}
+	__set_PRIMASK(primask);
+}
+
+/*------------------------------------------------------------------------*/
+/*
+  @brief: Blocking full duplex transfer with the bus kept busy back-to-back.
+  	  	  Chip select is handled by the caller.
+ @param: tx_data: Bytes to send, NULL to send 0xFF
+ 	 	 rx_data: Buffer for received bytes, NULL to discard them
+ 	 	 length: Number of bytes
+ @return: None
+ */
+/*-----------------------------------------------------------------------*/
+void SPI_transfer(const uint8_t* tx_data, uint8_t* rx_data, size_t length)
+{
+	wait_queue_idle();
+	stream_transfer(NULL, 0, tx_data, rx_data, length);
+}
+
 /*------------------------------------------------------------------------*/
 /*
   @brief: Read a specific register using SPI
- @param: reg_addr: Register addr that is to be read
+ @param: cs: Chip select of the device
+ 	 	 reg_addr: Register addr that is to be read
  	 	 read_data: Pointer variable in which data is to be stored
  @return: None
  */
 /*-----------------------------------------------------------------------*/
-void SPI_read_register(uint8_t reg_addr,uint8_t* read_data)
+void SPI_read_register(const spi_cs_t* cs, uint8_t reg_addr,uint8_t* read_data)
 {
-	uint8_t dummy_data = 0;
-	gpio_off(SPI_CS_PORT, SPI_CS_PIN); //Turn CS low
+	SPI_multibyte_read_register(cs, reg_addr, read_data, 1);
+}
 
-	SPI_write_byte(reg_addr); //Write reg addr
+/*------------------------------------------------------------------------*/
+/*
+  @brief: Write to a specific register using SPI
+ @param: cs: Chip select of the device
+ 	 	 reg_addr: Register addr that is to be written
+ 	 	 data: Value to be written
+ @return: None
+ */
+/*-----------------------------------------------------------------------*/
+void SPI_write_register(const spi_cs_t* cs, uint8_t reg_addr, uint8_t data)
+{
+	uint8_t addr = reg_addr & 0x7F; //Clear read bit
 
-	SPI_read_byte(&dummy_data); //read dummy data
+	wait_queue_idle();
+	cs_select(cs, addr, 2);
 
-	SPI_write_byte(0xFF);
+	stream_transfer(&addr, 1, &data, NULL, 1);
 
-	SPI_read_byte(read_data); //read data from specified reg. addr
+	cs_release(cs);
+}
 
-	gpio_on(SPI_CS_PORT, SPI_CS_PIN); //Turn CS high
+/*------------------------------------------------------------------------*/
+/*
+  @brief: Read consecutive registers in a single chip select cycle. The address
+  	  	  is sent once and the sensor auto-increments it for every following byte.
+ @param: cs: Chip select of the device
+ 	 	 reg_addr: Address of first register that is to be read
+ 	 	 read_data: Buffer in which register values are to be stored
+ 	 	 num_regs: Number of registers to be read
+ @return: None
+ */
+/*-----------------------------------------------------------------------*/
+void SPI_multibyte_read_register(const spi_cs_t* cs, uint8_t reg_addr,uint8_t* read_data, uint8_t num_regs)
+{
+	wait_queue_idle();
+	cs_select(cs, reg_addr, num_regs + 1);
 
+	stream_transfer(&reg_addr, 1, NULL, read_data, num_regs);
+
+	cs_release(cs);
 }
 
 /*------------------------------------------------------------------------*/
 /*
-  @brief: Write to a specific register using SPI
- @param: reg_addr: Register addr that is to be read
- 	 	 read_data: Pointer variable in which data is to be stored
+  @brief: Start a full duplex transfer handled by DMA and return immediately.
+  	  	  CS is held low until the last byte has been received, then the
+  	  	  callback is called from DMA0_IRQHandler.
+ @param: cs: Chip select of the device
+ 	 	 tx_data: Bytes to send, NULL to send 0xFF
+ 	 	 rx_data: Buffer for received bytes, NULL to discard them
+ 	 	 length: Number of bytes, both buffers must stay valid until completion
+ 	 	 callback: Function called on completion, can be NULL
+ 	 	 ctx: Argument passed to callback
+ @return: SPI_SUCCESS if transfer was started, SPI_BUSY if DMA or the
+ 	 	  interrupt driven queue is using the bus, SPI_ERROR if length is invalid
+ @Reference: KL25 Sub-Family Reference Manual chapter 23 (DMA) and 37 (SPI)
+ */
+/*-----------------------------------------------------------------------*/
+spi_status_e SPI_transfer_dma(const spi_cs_t* cs, const uint8_t* tx_data, uint8_t* rx_data, size_t length, spi_callback_t callback, void* ctx)
+{
+	if(length == 0 || length > SPI_DMA_MAX_LEN)
+	{
+		return SPI_ERROR;
+	}
+
+	//Completion callbacks start transfers from interrupt, test and claim must not be split
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if(dma_busy || (!SPI_QUEUE_USE_DMA && queue_count != 0))
+	{
+		__set_PRIMASK(primask);
+		return SPI_BUSY;
+	}
+	dma_busy = 1;
+	__set_PRIMASK(primask);
+
+	dma_cs = cs;
+	dma_callback = callback;
+	dma_ctx = ctx;
+
+	DMA0->DMA[SPI_DMA_RX_CHANNEL].DSR_BCR = DMA_DSR_BCR_DONE_MASK; //Clear status of previous transfer
+	DMA0->DMA[SPI_DMA_TX_CHANNEL].DSR_BCR = DMA_DSR_BCR_DONE_MASK;
+
+	//RX: data register -> memory, interrupt when byte count reaches zero
+	DMA0->DMA[SPI_DMA_RX_CHANNEL].SAR = DMA_ADDR(&SPI0->D);
+	DMA0->DMA[SPI_DMA_RX_CHANNEL].DAR = DMA_ADDR(rx_data ? rx_data : &dma_rx_discard);
+	DMA0->DMA[SPI_DMA_RX_CHANNEL].DSR_BCR = DMA_DSR_BCR_BCR(length);
+	DMA0->DMA[SPI_DMA_RX_CHANNEL].DCR = SPI_DMA_DCR_COMMON | DMA_DCR_EINT_MASK | (rx_data ? DMA_DCR_DINC_MASK : 0);
+
+	//TX: memory -> data register
+	DMA0->DMA[SPI_DMA_TX_CHANNEL].SAR = DMA_ADDR(tx_data ? tx_data : &dma_tx_idle);
+	DMA0->DMA[SPI_DMA_TX_CHANNEL].DAR = DMA_ADDR(&SPI0->D);
+	DMA0->DMA[SPI_DMA_TX_CHANNEL].DSR_BCR = DMA_DSR_BCR_BCR(length);
+	DMA0->DMA[SPI_DMA_TX_CHANNEL].DCR = SPI_DMA_DCR_COMMON | (tx_data ? DMA_DCR_SINC_MASK : 0);
+
+	cs_select(cs, tx_data ? tx_data[0] : 0xFF, length);
+
+	SPI0->C2 |= SPI_C2_RXDMAE_MASK | SPI_C2_TXDMAE_MASK; //Requests start flowing, first byte is sent right away
+
+	return SPI_SUCCESS;
+}
+
+/*------------------------------------------------------------------------*/
+/*
+  @brief: Check whether a DMA transfer is running
+ @param: None
+ @return: 1 if busy, 0 if idle
+ */
+/*-----------------------------------------------------------------------*/
+uint8_t SPI_dma_busy()
+{
+	return dma_busy;
+}
+
+static void queue_start_head();
+
+/*------------------------------------------------------------------------*/
+/*
+  @brief: Let the bytes already handed to SPI0 finish and throw away what
+  	  	  they received, so the next transfer does not take a stale byte
+  	  	  left in D with SPRF set for its first reply. Up to two bytes can
+  	  	  be in flight, one shifting and one in the transmit buffer. SPI0
+  	  	  has no busy flag, so status is polled for as long as two bytes
+  	  	  take at the current rate, each poll costs at least a bus cycle.
+ @param: None
  @return: None
  */
 /*-----------------------------------------------------------------------*/
-void SPI_write_register(uint8_t reg_addr, uint8_t data)
+static void spi_drain()
 {
-	uint8_t dummy_data = 0;
-	gpio_off(SPI_CS_PORT, SPI_CS_PIN); //Turn CS low
+	uint8_t br = SPI0->BR;
+	uint32_t divisor = ((uint32_t)((br & SPI_BR_SPPR_MASK) >> SPI_BR_SPPR_SHIFT) + 1) << (((br & SPI_BR_SPR_MASK) >> SPI_BR_SPR_SHIFT) + 1);
 
-	SPI_write_byte(reg_addr & 0x7F); //Write reg addr
+	for(uint32_t poll = 0; poll < 2 * 8 * divisor; poll++)
+	{
+		if(SPI0->S & SPI_S_SPRF_MASK)
+		{
+			(void)SPI0->D; //S read with SPRF set, then D, clears SPRF
+		}
+	}
+}
 
-	SPI_read_byte(&dummy_data); //Read dummy data
+/*------------------------------------------------------------------------*/
+/*
+  @brief: RX channel interrupt. The last byte has been clocked in, or a
+  	  	  channel stopped on an error, so release the bus and notify the
+  	  	  owner of the transfer. An error of the TX channel alone raises no
+  	  	  interrupt, the RX channel then never completes and the owner's
+  	  	  timeout has to call spi_abort.
+  	  	  A queued transaction that found the bus taken by a direct transfer
+  	  	  is started once that transfer is done.
+ @param: None
+ @return: None
+ */
+/*-----------------------------------------------------------------------*/
+void DMA0_IRQHandler(void)
+{
+	uint32_t errors = (DMA0->DMA[SPI_DMA_RX_CHANNEL].DSR_BCR | DMA0->DMA[SPI_DMA_TX_CHANNEL].DSR_BCR) &
+					  (DMA_DSR_BCR_CE_MASK | DMA_DSR_BCR_BES_MASK | DMA_DSR_BCR_BED_MASK);
+	spi_status_e status = errors ? SPI_BUS_ERROR : SPI_SUCCESS;
 
-	SPI_write_byte(data); //write data to specified reg. addr
+	SPI0->C2 &= ~(SPI_C2_RXDMAE_MASK | SPI_C2_TXDMAE_MASK);
+	if(errors)
+	{
+		DMA0->DMA[SPI_DMA_RX_CHANNEL].DCR &= ~DMA_DCR_ERQ_MASK; //The other channel may still be armed
+		DMA0->DMA[SPI_DMA_TX_CHANNEL].DCR &= ~DMA_DCR_ERQ_MASK;
+		spi_drain(); //Transfer stopped part way
+	}
 
-	SPI_read_byte(&dummy_data); //Read dummy data
+	DMA0->DMA[SPI_DMA_RX_CHANNEL].DSR_BCR = DMA_DSR_BCR_DONE_MASK; //Clear interrupt and error flags
+	DMA0->DMA[SPI_DMA_TX_CHANNEL].DSR_BCR = DMA_DSR_BCR_DONE_MASK;
 
-	gpio_on(SPI_CS_PORT, SPI_CS_PIN); //Turn CS high
+	cs_release(dma_cs);
+
+	dma_busy = 0;
+	if(dma_callback)
+	{
+		dma_callback(dma_ctx, status);
+	}
+
+	if(queue_start_pending && queue_count != 0 && !dma_busy)
+	{
+		queue_start_head();
+	}
 }
 
 /*------------------------------------------------------------------------*/
 /*
-  @brief: Read a specific register using SPI
- @param: reg_addr: Register addr that is to be read
- 	 	 read_data: Pointer variable in which data is to be stored
+  @brief: Finish the running transaction, start the next one and notify the
+  	  	  owner. Called from interrupt.
+ @param: status: Passed to the callback of the transaction
+ @return: None
+ */
+/*-----------------------------------------------------------------------*/
+static void queue_complete_head(spi_status_e status)
+{
+	spi_txn_t* txn = txn_queue[queue_head];
+
+	txn->latency_us = get_time_us() - txn->submit_us;
+	queue_stats.completed++;
+	queue_stats.last_latency_us = txn->latency_us;
+	if(txn->latency_us > queue_stats.max_latency_us)
+	{
+		queue_stats.max_latency_us = txn->latency_us;
+	}
+
+	queue_head = (queue_head + 1) % SPI_QUEUE_LEN;
+	queue_count--;
+
+	if(queue_count != 0)
+	{
+		queue_start_head(); //Keep the bus busy before running the callback
+	}
+#if !SPI_QUEUE_USE_DMA
+	else
+	{
+		SPI0->C1 &= ~SPI_C1_SPIE_MASK;
+	}
+#endif
+
+	if(txn->callback)
+	{
+		txn->callback(txn->ctx, status);
+	}
+}
+
+#if SPI_QUEUE_USE_DMA
+/*------------------------------------------------------------------------*/
+/*
+  @brief: DMA completion of a queued transaction, CS is already high
+ @param: ctx: Unused
+ 	 	 status: Outcome of the transfer
+ @return: None
+ */
+/*-----------------------------------------------------------------------*/
+static void queue_dma_done(void* ctx, spi_status_e status)
+{
+	(void)ctx;
+	queue_complete_head(status);
+}
+#endif
+
+/*------------------------------------------------------------------------*/
+/*
+  @brief: Put the transaction at the head of the queue on the bus. If a
+  	  	  direct SPI_transfer_dma owns the bus, the start is left pending and
+  	  	  DMA0_IRQHandler retries when that transfer is done.
+ @param: None
  @return: None
  */
 /*-----------------------------------------------------------------------*/
-void SPI_multibyte_read_register(uint8_t reg_addr,uint8_t* read_data, uint8_t num_regs)
+static void queue_start_head()
 {
-	uint8_t dummy_data = 0;
-	gpio_off(SPI_CS_PORT, SPI_CS_PIN); //Turn CS low
+	spi_txn_t* txn = txn_queue[queue_head];
 
-	for(uint8_t i = 0; i < num_regs; i++)
+#if SPI_QUEUE_USE_DMA
+	queue_start_pending = (SPI_transfer_dma(txn->cs, txn->tx_data, txn->rx_data, txn->length, queue_dma_done, NULL) != SPI_SUCCESS);
+#else
+	queue_start_pending = dma_busy;
+	if(queue_start_pending)
 	{
-		SPI_write_byte(reg_addr); //Write reg addr
+		return;
+	}
 
-		SPI_read_byte(&dummy_data); //read dummy data
+	txn_pos = 0;
+	cs_select(txn->cs, txn->tx_data ? txn->tx_data[0] : 0xFF, txn->length);
 
-		SPI_write_byte(0xFF);
+	SPI0->C1 |= SPI_C1_SPIE_MASK; //Interrupt on every received byte
+	(void)SPI0->S; //Status must be read before writing data register
+	SPI0->D = txn->tx_data ? txn->tx_data[0] : 0xFF;
+#endif
+}
 
-		SPI_read_byte(&read_data[i]); //read data from specified reg. addr
+/*------------------------------------------------------------------------*/
+/*
+  @brief: Queue a transaction. It is started right away if the bus is idle,
+  	  	  otherwise when the transactions before it have completed.
+  	  	  Can be called from main loop or from a completion callback.
+ @param: txn: Transaction to queue
+ @return: SPI_SUCCESS if queued, SPI_BUSY if queue is full, SPI_ERROR if
+ 	 	  transaction is invalid
+ */
+/*-----------------------------------------------------------------------*/
+spi_status_e spi_submit(spi_txn_t* txn)
+{
+	if(txn == NULL || txn->cs == NULL || txn->length == 0 || txn->length > SPI_DMA_MAX_LEN)
+	{
+		return SPI_ERROR;
+	}
 
-		reg_addr += 1; //Next reg address
+	uint32_t primask = __get_PRIMASK(); //Callbacks submit from interrupt context
+	__disable_irq(); //critical section
+	if(queue_count == SPI_QUEUE_LEN)
+	{
+		__set_PRIMASK(primask);
+		return SPI_BUSY;
 	}
 
+	txn->submit_us = get_time_us();
+	txn->latency_us = 0;
+	txn_queue[(queue_head + queue_count) % SPI_QUEUE_LEN] = txn;
+	queue_count++;
+
+	if(queue_count > queue_stats.max_depth)
+	{
+		queue_stats.max_depth = queue_count;
+	}
+
+	if(queue_count == 1)
+	{
+		queue_start_head(); //Bus was idle
+	}
+	__set_PRIMASK(primask);
+
+	return SPI_SUCCESS;
+}
+
+/*------------------------------------------------------------------------*/
+/*
+  @brief: Abandon the running transaction and drop every queued one, e.g.
+  	  	  when the owner gave up waiting for them. The DMA channels and SPI
+  	  	  interrupt are stopped, the bytes still in flight are drained and
+  	  	  chip select is released. Callbacks of the dropped transactions are
+  	  	  not called.
+ @param: None
+ @return: Number of transactions dropped
+ */
+/*-----------------------------------------------------------------------*/
+uint8_t spi_abort()
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
 
-	gpio_on(SPI_CS_PORT, SPI_CS_PIN); //Turn CS high
+	uint8_t dropped = queue_count;
 
+	SPI0->C1 &= ~SPI_C1_SPIE_MASK;
+	SPI0->C2 &= ~(SPI_C2_RXDMAE_MASK | SPI_C2_TXDMAE_MASK);
+	DMA0->DMA[SPI_DMA_RX_CHANNEL].DCR &= ~DMA_DCR_ERQ_MASK;
+	DMA0->DMA[SPI_DMA_TX_CHANNEL].DCR &= ~DMA_DCR_ERQ_MASK;
+	DMA0->DMA[SPI_DMA_RX_CHANNEL].DSR_BCR = DMA_DSR_BCR_DONE_MASK; //Clear byte count and pending interrupt
+	DMA0->DMA[SPI_DMA_TX_CHANNEL].DSR_BCR = DMA_DSR_BCR_DONE_MASK;
+	spi_drain();
+
+	if(dma_busy)
+	{
+		cs_release(dma_cs); //Direct transfer or head of the DMA driven queue
+	}
+	else if(queue_count != 0 && !queue_start_pending)
+	{
+		cs_release(txn_queue[queue_head]->cs); //Head of the interrupt driven queue
+	}
+
+	dma_busy = 0;
+	queue_head = 0;
+	queue_count = 0;
+	queue_start_pending = 0;
+
+	__set_PRIMASK(primask);
+
+	return dropped;
+}
+
+/*------------------------------------------------------------------------*/
+/*
+  @brief: Number of transactions queued, including the running one
+ @param: None
+ @return: Queue depth
+ */
+/*-----------------------------------------------------------------------*/
+uint8_t spi_queue_depth()
+{
+	return queue_count;
+}
+
+/*------------------------------------------------------------------------*/
+/*
+  @brief: Take a consistent copy of the queue statistics
+ @param: stats: Structure in which statistics are copied
+ @return: None
+ */
+/*-----------------------------------------------------------------------*/
+void spi_get_queue_stats(spi_queue_stats_t* stats)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	*stats = queue_stats;
+	stats->depth = queue_count;
+	__set_PRIMASK(primask);
+}
+
+#if !SPI_QUEUE_USE_DMA
+/*------------------------------------------------------------------------*/
+/*
+  @brief: SPI0 interrupt, one per received byte of the running transaction.
+  	  	  Store the byte and send the next one, or complete the transaction.
+ @param: None
+ @return: None
+ */
+/*-----------------------------------------------------------------------*/
+void SPI0_IRQHandler(void)
+{
+	if(!(SPI0->S & SPI_S_SPRF_MASK) || queue_count == 0)
+	{
+		return;
+	}
+
+	spi_txn_t* txn = txn_queue[queue_head];
+	uint8_t data = SPI0->D;
+
+	if(txn->rx_data)
+	{
+		txn->rx_data[txn_pos] = data;
+	}
+	txn_pos++;
+
+	if(txn_pos < txn->length)
+	{
+		SPI0->D = txn->tx_data ? txn->tx_data[txn_pos] : 0xFF; //SPTEF is set, S was read above
+		return;
+	}
+
+	cs_release(txn->cs);
+	queue_complete_head(SPI_SUCCESS);
+}
+#endif
+
+/*------------------------------------------------------------------------*/
+/*
+  @brief: Number of chip select cycles traced since power up. Only the last
+  	  	  SPI_TRACE_LEN of them are kept.
+ @param: None
+ @return: Trace sequence count, always 0 if tracer is compiled out
+ */
+/*-----------------------------------------------------------------------*/
+uint32_t spi_trace_count()
+{
+#if SPI_TRACE_ENABLE
+	return trace_seq;
+#else
+	return 0;
+#endif
+}
+
+/*------------------------------------------------------------------------*/
+/*
+  @brief: Copy one trace entry
+ @param: seq: Sequence number of entry, 0 is the first cycle after power up
+ 	 	 entry: Structure in which entry is copied
+ @return: 1 if entry was copied, 0 if it has been overwritten or not recorded yet
+ */
+/*-----------------------------------------------------------------------*/
+uint8_t spi_trace_read(uint32_t seq, spi_trace_entry_t* entry)
+{
+#if SPI_TRACE_ENABLE
+	uint8_t valid = 0;
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq(); //Queue completions record from interrupt
+	if(seq < trace_seq && (trace_seq - seq) <= SPI_TRACE_LEN)
+	{
+		*entry = trace_ring[seq % SPI_TRACE_LEN];
+		valid = 1;
+	}
+	__set_PRIMASK(primask);
+
+	return valid;
+#else
+	(void)seq;
+	(void)entry;
+	return 0;
+#endif
 }
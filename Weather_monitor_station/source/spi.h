@@ -11,23 +11,104 @@
 //                              Include files
 //***********************************************************************************
 #include <stdint.h>
+#include <stddef.h>
+#include "reg_access.h"
 //***********************************************************************************
 //                                  Macros
 //***********************************************************************************
+//Chip select GPIO of one device on the SPI bus
+typedef struct
+{
+	GPIO_Type* port;
+	uint8_t pin;
+}spi_cs_t;
 
+typedef enum
+{
+	SPI_SUCCESS = 0,
+	SPI_BUSY, //Previous transfer still running or queue full
+	SPI_ERROR, //Invalid argument
+	SPI_BUS_ERROR //DMA configuration or bus error, received data is not valid
+}spi_status_e;
+
+//Called from interrupt context when a transfer has completed, status is
+//SPI_SUCCESS or SPI_BUS_ERROR
+typedef void (*spi_callback_t)(void* ctx, spi_status_e status);
+
+//One chip select cycle queued with spi_submit. Owned by the caller and must
+//stay valid, together with its buffers, until the callback has been called.
+typedef struct
+{
+	const spi_cs_t* cs; //Chip select of the device
+	const uint8_t* tx_data; //Bytes to send, NULL to send 0xFF
+	uint8_t* rx_data; //Buffer for received bytes, NULL to discard them
+	size_t length; //Number of bytes
+	spi_callback_t callback; //Called from interrupt on completion, can be NULL
+	void* ctx; //Argument passed to callback
+	uint32_t submit_us; //Set by spi_submit
+	uint32_t latency_us; //Submit to completion, set before callback is called
+}spi_txn_t;
+
+//Queue statistics since power up
+typedef struct
+{
+	uint8_t depth; //Transactions queued, including the running one
+	uint8_t max_depth;
+	uint32_t completed;
+	uint32_t last_latency_us;
+	uint32_t max_latency_us;
+}spi_queue_stats_t;
+
+#ifndef SPI_TRACE_ENABLE
+#define SPI_TRACE_ENABLE		(0) //1: record every chip select cycle into a RAM ring
+#endif
+#define SPI_TRACE_LEN			(64) //Entries kept, oldest are overwritten
+#define SPI_TRACE_WRITE			(0)
+#define SPI_TRACE_READ			(1)
+
+//One chip select cycle recorded by the tracer
+typedef struct
+{
+	uint32_t start_us; //Time at which CS went low
+	uint32_t cs_low_us; //Time CS was held low
+	uint16_t length; //Bytes clocked including address byte
+	uint8_t reg_addr; //First byte with bit 7 set, BME280 register as numbered in datasheet
+	uint8_t dir; //SPI_TRACE_READ or SPI_TRACE_WRITE, bit 7 of first byte
+}spi_trace_entry_t;
+
+#define SPI_DEFAULT_FREQ_HZ		(10000000) //BME280 maximum SCK frequency
+
+#define SPI_QUEUE_LEN			(8) //Transactions that can be pending at once
+#ifndef SPI_QUEUE_USE_DMA
+#define SPI_QUEUE_USE_DMA		(1) //1: queued transfers are moved by DMA, 0: by SPI0 interrupt per byte
+#endif
+
+#define SPI_DMA_RX_CHANNEL		(0) //Raises the completion interrupt, RX finishes last
+#define SPI_DMA_TX_CHANNEL		(1)
+#define SPI_DMA_MAX_LEN			(0xFFFFF) //Byte count register is 20 bits wide
 
 
 //***********************************************************************************
 //                                  Function Prototype
 //***********************************************************************************
 void spi_init();
+uint32_t spi_set_frequency(uint32_t hz);
 void SPI_read_byte(uint8_t* data);
 void SPI_write_byte(uint8_t data);
 void SPI_write_multibyte(uint8_t* data, size_t length);
 void SPI_read_multibyte(uint8_t* data, size_t length);
-void SPI_read_register(uint8_t reg_addr,uint8_t* read_data);
-void SPI_write_register(uint8_t reg_addr, uint8_t data);
-void SPI_multibyte_read_register(uint8_t reg_addr,uint8_t* read_data, uint8_t num_regs);
+void SPI_transfer(const uint8_t* tx_data, uint8_t* rx_data, size_t length);
+void SPI_read_register(const spi_cs_t* cs, uint8_t reg_addr,uint8_t* read_data);
+void SPI_write_register(const spi_cs_t* cs, uint8_t reg_addr, uint8_t data);
+void SPI_multibyte_read_register(const spi_cs_t* cs, uint8_t reg_addr,uint8_t* read_data, uint8_t num_regs);
+spi_status_e SPI_transfer_dma(const spi_cs_t* cs, const uint8_t* tx_data, uint8_t* rx_data, size_t length, spi_callback_t callback, void* ctx);
+uint8_t SPI_dma_busy();
+spi_status_e spi_submit(spi_txn_t* txn);
+uint8_t spi_abort();
+uint8_t spi_queue_depth();
+void spi_get_queue_stats(spi_queue_stats_t* stats);
+uint32_t spi_trace_count();
+uint8_t spi_trace_read(uint32_t seq, spi_trace_entry_t* entry);
 
 
 #endif /* SPI_H_ */
@@ -9,41 +9,187 @@
 //***********************************************************************************
 //                              Include files
 //***********************************************************************************
-#include "MKL25Z4.h"
+#include "reg_access.h"
+#include <stdio.h>
 #include "gpio.h"
 #include "bme280.h"
 #include "statemachine.h"
+#include "systick.h"
+#include "cbfifo_typed.h"
 //***********************************************************************************
 //                                  Macros
 //***********************************************************************************
+#define SENSOR_CURRENT_BUDGET_NA (10000) //Average current allowed for the BME280
+#define STATION_PROFILE BME280_PROFILE_WEATHER_MONITORING //Datasheet recommendation for a weather station
+#define SAMPLE_FIFO_LEN (8) //Samples that can wait for transmission, power of two
+#define READ_BUS_TIMEOUT_US (10000) //Queued reads take ~20us per sensor, give up on the bus after this
 //***********************************************************************************
 //                              Structures
 //***********************************************************************************
 
 
-event_e event;
+//Raw frame of one sensor, queued between acquisition and transmission.
+//Frames are compensated when the queue is drained.
+typedef struct
+{
+	uint8_t sensor_id;
+	bme280_raw_t raw;
+}sample_t;
+
+CBFIFO_TYPED_DEFINE(sample_fifo, sample_t, SAMPLE_FIFO_LEN)
+
+volatile uint32_t event; //Bitmask of event_e, set from interrupts
 state_e state = STATE_IDLE;
-sensor_val_t sensor_val = {0};
+static sample_fifo_t samples; //Drained every period, old frames are dropped in the bluetooth ring instead
+
+//Sensors on the SPI bus, only the first num_sensors responded during init
+static bme280_dev_t sensors[NUM_SENSORS] =
+{
+	{.cs = {SPI_CS_PORT, SPI_CS_PIN}}, //Indoor
+	{.cs = {OUTDOOR_CS_PORT, OUTDOOR_CS_PIN}}, //Outdoor
+};
+static uint8_t num_sensors = 0;
+//Position of each responding sensor in the table above, 1 based. Sensors are
+//packed down during init, this keeps their numbers in samples and messages.
+static uint8_t sensor_id[NUM_SENSORS];
+static uint32_t meas_start_us = 0; //Time at which forced conversion was triggered
+static uint32_t meas_time_us = 0; //Expected conversion time
+static uint32_t read_start_us = 0; //Time at which sensor reads were queued
+static uint32_t reads_queued = 0; //Bit per sensor whose read was accepted by the SPI queue
+static volatile uint32_t reads_done = 0; //Bit per sensor whose read completed, set from interrupt
+static volatile uint32_t reads_failed = 0; //Bit per sensor whose read ended on a bus error, set from interrupt
 
 //***********************************************************************************
 //                                  Function definition
 //***********************************************************************************
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Initialise the sensors, drop the ones that don't respond and apply the
+ 	 	 station profile, or a cheaper one if it does not fit the sampling
+ 	 	 period and current budget
+ @param: None
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+void weather_monitor_init()
+{
+	bme280_profile_e profile = bme280_select_profile(STATION_PROFILE, get_timer_period_us(), SENSOR_CURRENT_BUDGET_NA);
+
+	if(profile != STATION_PROFILE)
+	{
+		printf("Station profile does not fit sampling period or current budget, using profile %d\n\r", profile);
+	}
+
+	num_sensors = 0;
+	for(uint8_t i = 0; i < NUM_SENSORS; i++)
+	{
+		//Test whether Environmental sensor is connected by reading chip ID
+		if(bme280_init(&sensors[i]) != CHIP_REV)
+		{
+			printf("Sensor %d did not respond with correct chip id val,Please check the connection\n\r", i + 1);
+			continue;
+		}
+
+		printf("BME280 sensor %d initialization is successfull\n\r", i + 1);
+		sensors[num_sensors] = sensors[i];
+		sensor_id[num_sensors] = i + 1;
+		bme280_apply_profile(&sensors[num_sensors], profile, MODE_SLEEP); //Conversions are triggered by the state machine
+		num_sensors++;
+	}
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Set an event. SysTick and the SPI completion run at different
+ 	 	 priorities and can preempt each other, so the read-modify-write of
+ 	 	 the event mask is done with interrupts masked.
+ @param: new_event: Event to be set
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void post_event(event_e new_event)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	event |= new_event;
+	__set_PRIMASK(primask);
+}
+
 void set_timer_event()
 {
-	event |= TIMER_EVENT;
+	post_event(TIMER_EVENT);
 }
 
-event_e get_event()
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Completion callback of a queued sensor read, called from interrupt
+ @param: ctx: Index of the sensor
+ 	 	 status: SPI_SUCCESS, or SPI_BUS_ERROR if the burst data is not valid
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+void set_spi_done_event(void* ctx, spi_status_e status)
 {
-	event_e temp_event = 0;
-	if(event & TIMER_EVENT)
+	//Completions run one after the other in the same interrupt
+	if(status == SPI_SUCCESS)
+	{
+		reads_done |= 1UL << (uintptr_t)ctx;
+	}
+	else
 	{
-		temp_event = TIMER_EVENT;
-		event &= ~(TIMER_EVENT);
+		reads_failed |= 1UL << (uintptr_t)ctx;
 	}
+	post_event(SPI_DONE_EVENT);
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Fetch and clear all pending events. Events are set from interrupts,
+ 	 	 so the read and clear must not be split by one.
+ @param: None
+ @return:Bitmask of pending events
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+event_e get_event()
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	event_e temp_event = (event_e)event;
+	event = 0;
+	__set_PRIMASK(primask);
 
 	return temp_event;
 }
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Drain the sample queue, compensating and sending the frames in the
+ 	 	 order they were taken. At most one frame per sensor is queued each
+ 	 	 period, too few for bme280_compensate_batch to pay off.
+ @param: None
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void transmit_samples()
+{
+	sample_t sample;
+
+	while(sample_fifo_dequeue(&samples, &sample) == CB_INSTANCE_SUCCESS)
+	{
+		for(uint8_t i = 0; i < num_sensors; i++)
+		{
+			if(sensor_id[i] != sample.sensor_id)
+			{
+				continue;
+			}
+
+			sensor_val_t val;
+			bme280_compensate(&sample.raw, bme280_get_calibration(&sensors[i]), &val);
+			transmit_sensors_val(sample.sensor_id, &val);
+			break;
+		}
+	}
+}
+
 /*-----------------------------------------------------------------------------------------------------------------------------*/
 /*
  @brief: State machine to manage weather monitoring station
@@ -61,7 +207,7 @@ void weather_monitor_statemachine()
 
 		case STATE_IDLE:
 		{
-			if(event == TIMER_EVENT)
+			if(event & TIMER_EVENT)
 			{
 				state = STATE_READ_SENSORS;
 			}
@@ -70,7 +216,100 @@ void weather_monitor_statemachine()
 
 		case STATE_READ_SENSORS:
 		{
-			read_sensors(&sensor_val);
+			//Start one conversion on every sensor, they return to sleep mode when done
+			meas_time_us = 0;
+			for(uint8_t i = 0; i < num_sensors; i++)
+			{
+				uint32_t time_us = bme280_trigger_forced(&sensors[i]);
+				if(time_us > meas_time_us)
+				{
+					meas_time_us = time_us;
+				}
+			}
+			meas_start_us = get_time_us();
+
+			state = STATE_WAIT_MEASUREMENT;
+		}
+		break;
+
+		case STATE_WAIT_MEASUREMENT:
+		{
+			//Don't poll the sensors before the conversion can possibly be done
+			if((get_time_us() - meas_start_us) < meas_time_us)
+			{
+				break;
+			}
+
+			uint8_t measuring = 0;
+			for(uint8_t i = 0; i < num_sensors && !measuring; i++)
+			{
+				measuring = bme280_is_measuring(&sensors[i]);
+			}
+
+			if(!measuring && num_sensors == 0)
+			{
+				state = STATE_TRANSMIT_VAL;
+			}
+			else if(!measuring)
+			{
+				//Queue a burst per sensor, the queue runs them back-to-back
+				reads_queued = 0;
+				reads_done = 0;
+				reads_failed = 0;
+				for(uint8_t i = 0; i < num_sensors; i++)
+				{
+					spi_status_e status = bme280_start_read(&sensors[i], set_spi_done_event, (void*)(uintptr_t)i);
+					if(status != SPI_SUCCESS)
+					{
+						printf("Read of sensor %d not queued (status %d), skipped this period\n\r", sensor_id[i], status);
+						continue;
+					}
+					reads_queued |= 1UL << i;
+				}
+				read_start_us = get_time_us();
+
+				state = (reads_queued != 0) ? STATE_READ_BUS : STATE_TRANSMIT_VAL;
+			}
+		}
+		break;
+
+		case STATE_READ_BUS:
+		{
+			uint32_t done = reads_done;
+			uint32_t failed = reads_failed;
+
+			if((done | failed) != reads_queued)
+			{
+				if((get_time_us() - read_start_us) < READ_BUS_TIMEOUT_US)
+				{
+					break;
+				}
+
+				//Bus is stuck, drop what is still queued and report what did complete
+				spi_abort();
+				done = reads_done;
+				printf("SPI reads timed out, sensors done 0x%lx of 0x%lx\n\r", (unsigned long)done, (unsigned long)reads_queued);
+			}
+
+			for(uint8_t i = 0; i < num_sensors; i++)
+			{
+				if(failed & (1UL << i))
+				{
+					printf("Read of sensor %d failed on a bus error, skipped this period\n\r", sensor_id[i]);
+				}
+				if(!(done & (1UL << i)))
+				{
+					continue;
+				}
+
+				sample_t sample = {.sensor_id = sensor_id[i]};
+				bme280_finish_read(&sensors[i], &sample.raw);
+
+				if(sample_fifo_enqueue(&samples, &sample) != CB_INSTANCE_SUCCESS)
+				{
+					printf("Sample of sensor %d dropped, sample queue full\n\r", sensor_id[i]);
+				}
+			}
 
 			state = STATE_TRANSMIT_VAL;
 		}
@@ -78,7 +317,7 @@ void weather_monitor_statemachine()
 
 		case STATE_TRANSMIT_VAL:
 		{
-			transmit_sensors_val(&sensor_val);
+			transmit_samples();
 			state = STATE_IDLE;
 		}
 		break;
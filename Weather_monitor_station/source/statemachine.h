@@ -10,26 +10,34 @@
 //***********************************************************************************
 //                              Include files
 //***********************************************************************************
+#include "spi.h"
 
 //***********************************************************************************
 //                                  Macros
 //***********************************************************************************
+#define NUM_SENSORS (2) //Indoor and outdoor BME280 on the same SPI bus
+
 typedef enum
 {
 	TIMER_EVENT = 1,
+	SPI_DONE_EVENT = 2 //A queued sensor read completed
 }event_e;
 
 typedef enum
 {
 	STATE_IDLE = 1,
 	STATE_READ_SENSORS = 2,
-	STATE_TRANSMIT_VAL =  4
+	STATE_TRANSMIT_VAL =  4,
+	STATE_WAIT_MEASUREMENT = 8,
+	STATE_READ_BUS = 16
 }state_e;
 
 //***********************************************************************************
 //                                  Function Prototype
 //***********************************************************************************
+void weather_monitor_init();
 void set_timer_event();
+void set_spi_done_event(void* ctx, spi_status_e status);
 event_e get_event();
 void weather_monitor_statemachine();
 #endif /* STATEMACHINE_H_ */
@@ -10,7 +10,7 @@
 //***********************************************************************************
 //                              Include files
 //***********************************************************************************
-#include "MKL25Z4.h"
+#include "reg_access.h"
 #include "systick.h"
 #include "gpio.h"
 #include "statemachine.h"
@@ -19,6 +19,7 @@
 //***********************************************************************************
 //                                  Macros
 //***********************************************************************************
+#define SYSTICK_TICKS_PER_US ((48000000 / 16) / 1000000) //CLKSOURCE = 0 selects core clock/16
 
 
 
@@ -30,6 +31,8 @@
 //***********************************************************************************
 //                                  Structure
 //***********************************************************************************
+static volatile uint32_t systick_us = 0; //Time elapsed at the last reload
+static uint32_t systick_period_us = 0; //Time between two reloads
 
 /*---------------------------------------------------*/
 /*
@@ -40,6 +43,7 @@
 -------------------------------------------------*/
 void SysTick_Handler(void){
 
+	systick_us += systick_period_us;
 	set_timer_event();
 }
 
@@ -59,6 +63,56 @@ void systick_init()
 	NVIC_SetPriority(SysTick_IRQn, 3);
 	SysTick->VAL = 0;
 	SysTick->CTRL = SysTick_CTRL_TICKINT_Msk | SysTick_CTRL_ENABLE_Msk;
+
+	//LOAD is only 24 bits wide, so use the value the hardware actually kept
+	systick_period_us = (SysTick->LOAD + 1) / SYSTICK_TICKS_PER_US;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Get the time between two timer events
+@param: None
+ @return: Systick period in microseconds
+ @Reference:
+ -------------------------------------------------------------------------------*/
+uint32_t get_timer_period_us()
+{
+	return systick_period_us;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Get a free running timestamp derived from the systick counter.
+ 	 	 Safe with interrupts masked and from any interrupt: a reload whose
+ 	 	 SysTick_Handler has not run yet is seen as a pending SysTick
+ 	 	 exception and its period is added here, so time never goes backwards.
+@param: None
+ @return: Time since systick_init in microseconds, wraps every ~71 minutes
+ @Reference: ARMv6-M Architecture Reference Manual B3.2.4, ICSR.PENDSTSET
+ -------------------------------------------------------------------------------*/
+uint32_t get_time_us()
+{
+	uint32_t base_us = 0;
+	uint32_t count = 0;
+	uint32_t count_before = 0;
+	uint32_t pending = 0;
+
+	do
+	{
+		base_us = systick_us;
+		count_before = SysTick->VAL;
+		pending = SCB->ICSR & SCB_ICSR_PENDSTSET_Msk;
+		count = SysTick->VAL;
+		//Counter counts down, a larger second value means it reloaded while
+		//pending was sampled. A changed base means SysTick_Handler ran.
+	}while(count > count_before || base_us != systick_us);
+
+	if(pending)
+	{
+		base_us += systick_period_us; //Reloaded, handler has not run yet
+	}
+
+	return base_us + ((SysTick->LOAD - count) / SYSTICK_TICKS_PER_US);
 }
 
 
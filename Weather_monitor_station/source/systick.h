@@ -12,7 +12,7 @@
 //***********************************************************************************
 //                              Include files
 //***********************************************************************************
-#include "MKL25Z4.h"
+#include "reg_access.h"
 
 
 
@@ -31,6 +31,8 @@
 //***********************************************************************************
 
 void systick_init();
+uint32_t get_time_us();
+uint32_t get_timer_period_us();
 
 
 #endif // _GPIO_H
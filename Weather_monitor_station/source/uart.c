@@ -10,7 +10,7 @@
 //***********************************************************************************
 //                              Include files
 //***********************************************************************************
-#include "MKL25Z4.h"
+#include "reg_access.h"
 #include "uart.h"
 #include "cbfifo.h"
 #include <string.h>
@@ -30,33 +30,113 @@
 #define UART1_BAUD_RATE (9600)
 #define SYSCLOCK_FREQUENCY (24000000U)
 
+#define DMAMUX_SRC_UART1_TX	(5)
+
+//8 bit accesses, one byte per request, request cleared when byte count reaches zero
+#define UART1_DMA_DCR		(DMA_DCR_EINT_MASK | DMA_DCR_ERQ_MASK | DMA_DCR_CS_MASK | DMA_DCR_SINC_MASK | \
+							 DMA_DCR_SSIZE(1) | DMA_DCR_DSIZE(1) | DMA_DCR_D_REQ_MASK)
+
+//Frames are sent from the ring in place. The source address wraps at the end
+//of the ring, 8 << SMOD bytes, so a frame split by the wrap is still one transfer.
+#define UART1_RING_SMOD		(6)
+typedef char uart1_ring_smod_check[(8 << UART1_RING_SMOD) == UART1_TX_FIFO_LEN ? 1 : -1];
+
+//***********************************************************************************
+//                              Global variables
+//***********************************************************************************
+CBFIFO_DEFINE(uart0_tx_fifo, UART0_TX_FIFO_LEN); //printf output, drained by UART0_IRQHandler
+CBFIFO_DEFINE(uart0_rx_fifo, UART0_RX_FIFO_LEN); //Filled by UART0_IRQHandler, read by console
+//Bluetooth frames, each behind a length byte. When full, whole oldest frames
+//are dropped so the newest readings get through after a stall.
+CBFIFO_DEFINE_ALIGNED(uart1_tx_fifo, UART1_TX_FIFO_LEN, CB_POLICY_OVERWRITE);
+
+//Frame being sent straight from the front of the ring, length byte included.
+//It is released once its last byte is out, uart1_make_room drops behind it.
+static volatile size_t tx_frame_len = 0; //0 while no frame is being sent
+static volatile size_t tx_frame_pos = 0; //Next byte for UART1_IRQHandler
+
+//State of the transfer owned by the DMA, shared with DMA2_IRQHandler
+static volatile uint8_t dma_busy = 0;
+static uart_callback_t dma_callback = NULL;
+static void* dma_ctx = NULL;
+
 //***********************************************************************************
 //                                  Function definition
 //***********************************************************************************
-void UART0_IRQHandler(void)
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Byte of a ring peeked in two spans
+ @param: span1, span2: Spans from cbfifo_peek
+ 	 	 offset: Bytes after the oldest one
+ @return: The byte
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static inline uint8_t span_byte(const cb_span_t* span1, const cb_span_t* span2, size_t offset)
+{
+	return (offset < span1->length) ? span1->data[offset] : span2->data[offset - span1->length];
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Start sending the oldest bluetooth frame, if none is being sent.
+ 		 The frame stays in the ring, only its length is read.
+ 		 Called by the consumer, from interrupt or from main loop.
+ @param: span1, span2: Filled with the queued data, frame first
+ @return: Length of the frame being sent, length byte included, 0 if none
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static size_t uart1_take_frame(cb_span_t* span1, cb_span_t* span2)
+{
+	uint32_t primask = cb_critical_enter(); //uart1_make_room must see the frame as taken or not
+
+	if(cbfifo_peek(&uart1_tx_fifo, span1, span2) != 0 && tx_frame_len == 0)
+	{
+		tx_frame_len = 1 + span1->data[0];
+		tx_frame_pos = 1;
+	}
+
+	cb_critical_exit(primask);
+
+	return tx_frame_len;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Last byte of the frame being sent is out of the ring, free it
+ @param: None
+ @return: None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void uart1_release_frame()
 {
+	uint32_t primask = cb_critical_enter(); //Producer may be dropping frames behind it
 
-	__disable_irq();     //critical section
-	cb_error_status_e cb_status = CB_INSTANCE_SUCCESS;
+	cbfifo_release(&uart1_tx_fifo, tx_frame_len);
+	tx_frame_len = 0;
+
+	cb_critical_exit(primask);
+}
+
+void UART0_IRQHandler(void)
+{
+	//No critical section needed, this ISR is the only Rx producer and Tx consumer
 
 	//if any character is received in data register, then Rx interrupt will be triggered
 	if(UART0->S1 & UART0_S1_RDRF_MASK) //when data register is full
 	{
 		uint8_t rcvd_val = 0;
 		rcvd_val = UART0->D;
-		cb_status = cbfifo_enqueue(RX_BUFFER,&rcvd_val); //Enqueue the received data into Rx buffer(accessed via handler)
+		cbfifo_enqueue(&uart0_rx_fifo,&rcvd_val); //Enqueue the received data into Rx buffer(accessed via handler)
 	}
 
 	 if((UART0->C2 & UART0_C2_TIE_MASK) &&
 	    (UART0->S1 & UART0_S1_TDRE_MASK)){
-			uint8_t tx_val = 0;
-			  //Can sen another character
-				cb_status = cbfifo_dequeue(TX_BUFFER, &tx_val);
-
-				//Only proceed with transmission if circular buffer is not empty
-				if(cb_status != CB_EMPTY && cb_status != CB_INSTANCE_ERROR)
+			cb_span_t span1, span2;
+			  //Can send another character, straight from ring memory
+				if(cbfifo_peek(&uart0_tx_fifo, &span1, &span2) != 0)
 				{
-					UART0->D = tx_val;
+					UART0->D = span1.data[0];
+					cbfifo_release(&uart0_tx_fifo, 1);
 				}
 			  else{
 			   //queue is empty so disable transmitter interrupt
@@ -64,37 +144,126 @@ void UART0_IRQHandler(void)
 			  }
 
 	 }
+}
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Send queued bluetooth data, one byte per TDRE interrupt
+ @param: None
+ @return: None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+void UART1_IRQHandler(void)
+{
+	//Only Tx interrupt is enabled on UART1, this ISR is the only consumer of the ring.
+	//While TDMAS is set TDRE requests DMA instead of this interrupt.
+	if((UART1->C2 & UART_C2_TIE_MASK) && !(UART1->C4 & UART_C4_TDMAS_MASK) &&
+	   (UART1->S1 & UART_S1_TDRE_MASK))
+	{
+		cb_span_t span1, span2;
+
+		if(uart1_take_frame(&span1, &span2) != 0)
+		{
+			UART1->D = span_byte(&span1, &span2, tx_frame_pos++);
+			if(tx_frame_pos == tx_frame_len)
+			{
+				uart1_release_frame(); //Last byte is in the shifter, ring memory no longer needed
+			}
+		}
+		else
+		{
+			//Nothing left to send, TDRE stays set so interrupt must be disabled
+			UART1->C2 &= ~UART_C2_TIE_MASK;
+		}
+	}
+}
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: DMA channel finished the frame given to uart1_send
+ @param: None
+ @return: None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+void DMA2_IRQHandler(void)
+{
+	UART1->C2 &= ~UART_C2_TIE_MASK;
+	UART1->C4 &= ~UART_C4_TDMAS_MASK;
 
+	DMA0->DMA[UART1_DMA_CHANNEL].DSR_BCR = DMA_DSR_BCR_DONE_MASK; //Clear interrupt and error flags
 
-	__enable_irq();
+	dma_busy = 0;
+	if(dma_callback)
+	{
+		dma_callback(dma_ctx);
+	}
 }
+
+static uart_status_e uart1_dma_start(const uint8_t* buf, size_t len, uint32_t dcr, uart_callback_t callback, void* ctx);
+
+#if UART1_TX_USE_DMA
+static void ring_dma_done(void* ctx);
+
 /*-----------------------------------------------------------------------------------------------------------------------------*/
 /*
- @brief: Implement sys_write functionality to link printf and UART
+ @brief: Hand the oldest frame of the ring to DMA, if DMA is idle. The
+ 	 	 channel reads it in place and wraps at the end of the ring.
+ 		 Called from main loop and from DMA2_IRQHandler.
  @param: None
  @return: None
  */
 /*-----------------------------------------------------------------------------------------------------------------------------*/
-int __sys_write(int handle, char *buf, int size)
+static void ring_dma_kick()
 {
-	int status = 0;
-	cb_error_status_e cb_status = CB_INSTANCE_SUCCESS;
+	cb_span_t span1, span2;
 
+	if(dma_busy)
+	{
+		return; //ring_dma_done picks up the new data
+	}
 
-	for(int i = 0; i < size ; i++)
+	size_t len = uart1_take_frame(&span1, &span2);
+	if(len != 0)
 	{
-		cb_status = cbfifo_enqueue(TX_BUFFER, &buf[i]); //
+		const uint8_t* data = (span1.length > 1) ? &span1.data[1] : span2.data; //Behind the length byte
+		uart1_dma_start(data, len - 1, UART1_DMA_DCR | DMA_DCR_SMOD(UART1_RING_SMOD), ring_dma_done, NULL);
+	}
+}
 
-		if(cb_status != CB_INSTANCE_SUCCESS)
-		{
-			status = -1;
-			break;
-		}
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Frame is on the wire, start on the next one. Called from interrupt.
+ @param: ctx: Unused
+ @return: None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void ring_dma_done(void* ctx)
+{
+	(void)ctx;
+
+	uart1_release_frame();
+	ring_dma_kick();
+}
+#endif
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Implement sys_write functionality to link printf and UART
+ @param: None
+ @return: None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+int __sys_write(int handle, char *buf, int size)
+{
+	int status = 0;
 
-		UART0->C2 |= UART0_C2_TIE(1); //transmit interrupt enable
+	(void)handle; //stdout and stderr both go to UART0
 
+	//Whole string in one copy, data that doesn't fit is dropped
+	if(cbfifo_enqueue_n(&uart0_tx_fifo, buf, size) != (size_t)size)
+	{
+		status = -1;
 	}
 
+	UART0->C2 |= UART0_C2_TIE(1); //transmit interrupt enable
 
 	return status;
 }
@@ -109,7 +278,7 @@ int __sys_readc(void)
 {
 	int status = 0;
 	//if buffer is empty, then no need to dequeue
-	cb_error_status_e cb_status = cbfifo_isempty(RX_BUFFER);
+	cb_error_status_e cb_status = cbfifo_isempty(&uart0_rx_fifo);
 
 	if(cb_status == CB_EMPTY || cb_status == CB_INSTANCE_ERROR)
 	{
@@ -118,7 +287,7 @@ int __sys_readc(void)
 	else
 	{
 		//Dequeue value from Rx circular buffer , return -1 on error and actual data byte on success
-		cb_status = cbfifo_dequeue(RX_BUFFER, &status);
+		cb_status = cbfifo_dequeue(&uart0_rx_fifo, &status);
 
 		if(cb_status == CB_INSTANCE_ERROR)
 		{
@@ -215,23 +384,253 @@ void uart1_init()
 	UART1->C1 = 0x00; /* normal 8-bit, no parity */
 	UART1->C3 = 0x00; /* no fault interrupt */
 	UART1->C2 |= UART_C2_TE(1) ;
+
+	//Tx interrupt is enabled by uart1_puts once data is queued
+	NVIC_EnableIRQ(UART1_IRQn);
+
+	//DMA channel for uart1_send, TDRE requests it while C4 TDMAS is set
+	SIM->SCGC6 |= SIM_SCGC6_DMAMUX_MASK; //Enable clock to DMA mux
+	SIM->SCGC7 |= SIM_SCGC7_DMA_MASK; //Enable clock to DMA controller
+
+	DMAMUX0->CHCFG[UART1_DMA_CHANNEL] = 0; //Disable channel before changing source
+	DMAMUX0->CHCFG[UART1_DMA_CHANNEL] = DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(DMAMUX_SRC_UART1_TX);
+
+	NVIC_SetPriority(DMA2_IRQn, 3); //Bluetooth is less urgent than the sensor bus
+	NVIC_ClearPendingIRQ(DMA2_IRQn);
+	NVIC_EnableIRQ(DMA2_IRQn);
+}
+/*-------------------------------------------------------------------------*/
+/*
+ @brief: Have queued bluetooth data sent in the background
+ @param: None
+ @return: None
+ */
+/*-------------------------------------------------------------------------*/
+static void uart1_start_tx()
+{
+#if UART1_TX_USE_DMA
+	ring_dma_kick();
+#else
+	UART1->C2 |= UART_C2_TIE(1); //transmit interrupt enable
+#endif
+}
+
+/*-------------------------------------------------------------------------*/
+/*
+ @brief: Drop whole frames, oldest first, until nbyte bytes are free. The
+ 	 	 frame being sent is skipped, the ones queued behind it are dropped
+ 	 	 with the newer frames moved down over them. That copy is only made
+ 	 	 when the ring overflows while a frame is on the wire.
+ @param: nbyte: Room needed, at most the ring capacity less one frame
+ @return: None
+ */
+/*-------------------------------------------------------------------------*/
+static void uart1_make_room(size_t nbyte)
+{
+	cb_span_t span1, span2;
+	uint32_t primask = cb_critical_enter(); //Consumer must not take or release a frame meanwhile
+	size_t keep = tx_frame_len;
+
+	while(cbfifo_capacity(&uart1_tx_fifo) - cbfifo_length(&uart1_tx_fifo) < nbyte &&
+		  cbfifo_peek(&uart1_tx_fifo, &span1, &span2) > keep)
+	{
+		size_t drop = 1 + span_byte(&span1, &span2, keep); //Length byte and its frame
+
+		if(keep == 0)
+		{
+			cbfifo_drop(&uart1_tx_fifo, drop);
+		}
+		else
+		{
+			cbfifo_drop_at(&uart1_tx_fifo, keep, drop);
+		}
+	}
+
+	cb_critical_exit(primask);
+}
+
+/*-------------------------------------------------------------------------*/
+/*
+ @brief: Start a bluetooth frame that is formatted straight into the ring.
+ 		 Room for max_len bytes is made up front, by dropping the oldest
+ 		 whole frames if needed, so the frame is queued whole or not at all.
+ @param: frame: Frame state, passed to uart1_frame_puts and uart1_frame_end
+ 	 	 max_len: Longest the frame can get, at most UART1_FRAME_MAX
+ @return: 1 if the room was reserved, 0 if max_len is too long
+ */
+/*-------------------------------------------------------------------------*/
+uint8_t uart1_frame_begin(uart1_frame_t* frame, size_t max_len)
+{
+	frame->length = 0;
+	frame->overflow = 0;
+	frame->header = NULL;
+	frame->span1.length = 0;
+	frame->span2.length = 0;
+
+	if(max_len > UART1_FRAME_MAX)
+	{
+		return 0;
+	}
+
+	uart1_make_room(max_len + 1);
+
+	//Only the consumer runs meanwhile, and it can only free more room
+	if(cbfifo_reserve(&uart1_tx_fifo, max_len + 1, &frame->span1, &frame->span2) < max_len + 1)
+	{
+		return 0;
+	}
+
+	//Length byte goes in front, filled in by uart1_frame_end
+	frame->header = frame->span1.data;
+	frame->span1.data++;
+	frame->span1.length--;
+
+	return 1;
 }
+
 /*-------------------------------------------------------------------------*/
 /*
- @brief: Send message through UART1
- @param: msg: Message to be sent to bluetooth
+ @brief: Append text to a frame, in the reserved ring memory
+ @param: frame: Frame started by uart1_frame_begin
+ 	 	 str: Null terminated text
  @return: None
  */
 /*-------------------------------------------------------------------------*/
-void uart1_puts(uint8_t* msg)
+void uart1_frame_puts(uart1_frame_t* frame, const char* str)
+{
+	for(; *str != '\0'; str++)
+	{
+		if(frame->length < frame->span1.length)
+		{
+			frame->span1.data[frame->length] = (uint8_t)*str;
+		}
+		else if(frame->length - frame->span1.length < frame->span2.length)
+		{
+			frame->span2.data[frame->length - frame->span1.length] = (uint8_t)*str;
+		}
+		else
+		{
+			frame->overflow = 1; //Longer than reserved, frame is dropped at the end
+			return;
+		}
+		frame->length++;
+	}
+}
+
+/*-------------------------------------------------------------------------*/
+/*
+ @brief: Publish a frame to the consumer and start sending it
+ @param: frame: Frame started by uart1_frame_begin
+ @return: Bytes queued, 0 if the frame was dropped
+ */
+/*-------------------------------------------------------------------------*/
+size_t uart1_frame_end(uart1_frame_t* frame)
+{
+	if(frame->header == NULL || frame->overflow || frame->length == 0)
+	{
+		return 0; //Nothing committed, reserved room stays free
+	}
+
+	*frame->header = (uint8_t)frame->length;
+	cbfifo_commit(&uart1_tx_fifo, frame->length + 1);
+	uart1_start_tx();
+
+	return frame->length;
+}
+
+/*-------------------------------------------------------------------------*/
+/*
+ @brief: Queue message for bluetooth, DMA or UART1_IRQHandler sends it in background
+ @param: msg: Null terminated message to be sent to bluetooth
+ @return: Number of bytes queued, 0 if message is longer than UART1_FRAME_MAX
+ */
+/*-------------------------------------------------------------------------*/
+size_t uart1_puts(const uint8_t* msg)
+{
+	uart1_frame_t frame;
+
+	if(msg == NULL)
+	{
+		return 0;
+	}
+
+	if(!uart1_frame_begin(&frame, strlen((const char*)msg)))
+	{
+		return 0;
+	}
+
+	uart1_frame_puts(&frame, (const char*)msg);
+
+	return uart1_frame_end(&frame);
+}
+
+/*-------------------------------------------------------------------------*/
+/*
+ @brief: Start sending a frame by DMA, one interrupt when it has gone out.
+ 		 The buffer must stay valid until callback is called from DMA2_IRQHandler.
+ @param: buf: Bytes to send
+ 	 	 len: Number of bytes
+ 	 	 callback: Function called on completion, can be NULL
+ 	 	 ctx: Argument passed to callback
+ @return: UART_SUCCESS if transfer was started, UART_BUSY if UART1 is still
+ 	 	  sending, UART_ERROR if arguments are invalid
+ @Reference: KL25 Sub-Family Reference Manual chapter 23 (DMA) and 40 (UART)
+ */
+/*-------------------------------------------------------------------------*/
+uart_status_e uart1_send(const uint8_t* buf, size_t len, uart_callback_t callback, void* ctx)
 {
-	uint8_t i = 0;
-	while(msg[i] != '\0')
+	if(buf == NULL || len == 0 || len > UART1_DMA_MAX_LEN)
 	{
-		while(!(UART1->S1 & UART_S1_TDRE_MASK)); /* wait for transmit buffer empty */
-		UART1->D = msg[i];
-		i++;
+		return UART_ERROR;
 	}
+
+	return uart1_dma_start(buf, len, UART1_DMA_DCR, callback, ctx);
+}
+
+/*-------------------------------------------------------------------------*/
+/*
+ @brief: Program the UART1 TX channel, shared by uart1_send and the ring
+ @param: buf, len, callback, ctx: As for uart1_send
+ 	 	 dcr: Channel control, UART1_DMA_DCR with modulo addressing if needed
+ @return: UART_SUCCESS if transfer was started, UART_BUSY if UART1 is still sending
+ */
+/*-------------------------------------------------------------------------*/
+static uart_status_e uart1_dma_start(const uint8_t* buf, size_t len, uint32_t dcr, uart_callback_t callback, void* ctx)
+{
+	//Per byte interrupt path owns the data register while TIE is set without TDMAS
+	if(dma_busy || (UART1->C2 & UART_C2_TIE_MASK))
+	{
+		return UART_BUSY;
+	}
+
+	dma_busy = 1;
+	dma_callback = callback;
+	dma_ctx = ctx;
+
+	DMA0->DMA[UART1_DMA_CHANNEL].DSR_BCR = DMA_DSR_BCR_DONE_MASK; //Clear status of previous transfer
+
+	//Memory -> data register, interrupt when byte count reaches zero
+	DMA0->DMA[UART1_DMA_CHANNEL].SAR = DMA_ADDR(buf);
+	DMA0->DMA[UART1_DMA_CHANNEL].DAR = DMA_ADDR(&UART1->D);
+	DMA0->DMA[UART1_DMA_CHANNEL].DSR_BCR = DMA_DSR_BCR_BCR(len);
+	DMA0->DMA[UART1_DMA_CHANNEL].DCR = dcr;
+
+	UART1->C4 |= UART_C4_TDMAS_MASK;
+	UART1->C2 |= UART_C2_TIE_MASK; //TDRE is already set, first byte is requested right away
+
+	return UART_SUCCESS;
+}
+
+/*-------------------------------------------------------------------------*/
+/*
+ @brief: Check whether UART1 is still sending
+ @param: None
+ @return: 1 if a DMA transfer is running or data is queued, 0 if idle
+ */
+/*-------------------------------------------------------------------------*/
+uint8_t uart1_busy()
+{
+	return dma_busy || (cbfifo_length(&uart1_tx_fifo) != 0); //Frame being sent stays queued until its last byte is out
 }
 
 /*-------------------------------------------------------------------------*/
@@ -275,12 +674,12 @@ void my_itoa(size_t num,uint8_t* result)
 		return ;
 	}
 
-	while(num)
+	do
 	{
 		remainder = num % 10;
 		num = num / 10;
 		result[count++] = '0' + remainder;
-	}
+	}while(num); //Zero still produces a single digit
 
 	result[count] = '\0';
 	reverse_str(result, count);
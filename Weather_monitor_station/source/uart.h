@@ -12,10 +12,50 @@
 //                              Include files
 //***********************************************************************************
 #include <stdint.h>
+#include <stddef.h>
+#include "cbfifo.h"
 //***********************************************************************************
 //                                  Macros
 //***********************************************************************************
+#define UART0_TX_FIFO_LEN	(256) //Holds a few console lines, dumps wait for it to drain
+#define UART0_RX_FIFO_LEN	(64) //Console commands are at most CONSOLE_LINE_LEN characters
+#define UART1_TX_FIFO_LEN	(512) //One sample frame per sensor, about 0.5s of data at 9600 baud. Aligned to its size for the DMA.
+#define UART1_FRAME_MAX		(255) //Longest bluetooth frame, its length is queued in one byte
+#ifndef UART1_TX_USE_DMA
+#define UART1_TX_USE_DMA	(1) //1: ring is drained by DMA, 0: by UART1 interrupt per byte
+#endif
+#define UART1_DMA_CHANNEL	(2) //Channels 0 and 1 belong to SPI0
+#define UART1_DMA_MAX_LEN	(0xFFFFF) //Byte count register is 20 bits wide
 
+//***********************************************************************************
+//                              Structures
+//***********************************************************************************
+//Called from interrupt context when a transfer has completed
+typedef void (*uart_callback_t)(void* ctx);
+
+//Bluetooth frame written in place into uart1_tx_fifo, see uart1_frame_begin
+typedef struct
+{
+	uint8_t* header; //Length byte in front of the frame
+	cb_span_t span1; //Reserved ring memory
+	cb_span_t span2; //Part wrapped to start of ring, usually empty
+	size_t length; //Bytes written so far
+	uint8_t overflow; //Text did not fit the reservation
+}uart1_frame_t;
+
+typedef enum
+{
+	UART_SUCCESS = 0,
+	UART_BUSY, //Previous transfer or ring still being sent
+	UART_ERROR //Invalid argument
+}uart_status_e;
+
+//***********************************************************************************
+//                              Global variables
+//***********************************************************************************
+extern cb_t uart0_tx_fifo;
+extern cb_t uart0_rx_fifo;
+extern cb_t uart1_tx_fifo;
 
 
 //***********************************************************************************
@@ -23,7 +63,12 @@
 //***********************************************************************************
 void uart0_init();
 void uart1_init();
-void uart1_puts(uint8_t* msg);
+size_t uart1_puts(const uint8_t* msg);
+uint8_t uart1_frame_begin(uart1_frame_t* frame, size_t max_len);
+void uart1_frame_puts(uart1_frame_t* frame, const char* str);
+size_t uart1_frame_end(uart1_frame_t* frame);
+uart_status_e uart1_send(const uint8_t* buf, size_t len, uart_callback_t callback, void* ctx);
+uint8_t uart1_busy();
 void my_itoa(size_t num, uint8_t* input);
 
 #endif /* UART_H_ */
@@ -0,0 +1,240 @@
+/***********************************************************************************
+* @file bench_bme280_compensate.c
+ * @brief:Frames per second and cycles per frame of the compensation on the
+ *        host: the floating point formulas of the datasheet, as the old
+ *        float API computed them, against the fixed point bme280_compensate
+ *        one frame at a time and bme280_compensate_batch. Fails if the fixed
+ *        point results disagree with the datasheet pressure formula, or
+ *        stray from the floating point ones by more than their resolution.
+ *        Cycles are TSC cycles on x86-64 and are not printed elsewhere.
+ *        Pass a round count to run longer than the ctest run.
+ * @author Sayali Mule
+ * @date 12/04/2021
+ * @Reference:
+ *****************************************************************************/
+//***********************************************************************************
+//                              Include files
+//***********************************************************************************
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+#include "bme280_compensate.h"
+#include "test_util.h"
+
+//***********************************************************************************
+//                                  Macros
+//***********************************************************************************
+#define BENCH_FRAMES		(4096) //Fits in L1, measures the arithmetic only
+#define BENCH_ROUNDS		(50) //Default for the ctest run
+#define TEMP_TOLERANCE		(0.01) //DegC, one step of the fixed point result
+#define PRESSURE_TOLERANCE	(1.0) //Pa
+#define HUMIDITY_TOLERANCE	(0.05) //%RH
+
+static const bme280_calib_t calib =
+{
+	.dig_T1 = 27504, .dig_T2 = 26435, .dig_T3 = -1000,
+	.dig_P1 = 36477, .dig_P2 = -10685, .dig_P3 = 3024, .dig_P4 = 2855, .dig_P5 = 140,
+	.dig_P6 = -7, .dig_P7 = 15500, .dig_P8 = -14600, .dig_P9 = 6000,
+	.dig_H1 = 75, .dig_H2 = 362, .dig_H3 = 0, .dig_H4 = 313, .dig_H5 = 50, .dig_H6 = 30
+};
+
+static int32_t adc_P[BENCH_FRAMES], adc_T[BENCH_FRAMES], adc_H[BENCH_FRAMES];
+static int32_t temp_val[BENCH_FRAMES];
+static uint32_t pressure_val[BENCH_FRAMES], hum_val[BENCH_FRAMES];
+static uint32_t pressure_div[BENCH_FRAMES];
+static double temp_float[BENCH_FRAMES], pressure_float[BENCH_FRAMES], hum_float[BENCH_FRAMES];
+static volatile uint32_t sink; //Keeps the scalar loops from being optimised away
+
+//***********************************************************************************
+//                                  Function definition
+//***********************************************************************************
+static double now_s(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t now_cycles(void)
+{
+#if defined(__x86_64__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Compensation in floating point as printed in the datasheet, what
+ 	 	 the float API cost before the fixed point path
+ @param: adc_P, adc_T, adc_H: Raw values
+ 	 	 temp, pressure, hum: DegC, Pa and %RH
+ @return:None
+ @Reference: BME280 datasheet section 8.1
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void compensate_float(int32_t adc_P, int32_t adc_T, int32_t adc_H, double* temp, double* pressure, double* hum)
+{
+	double var1, var2, var3, var4, var5, var6, t_fine, p, h;
+
+	var1 = ((double)adc_T / 16384.0 - (double)calib.dig_T1 / 1024.0) * (double)calib.dig_T2;
+	var2 = ((double)adc_T / 131072.0 - (double)calib.dig_T1 / 8192.0);
+	var2 = var2 * var2 * (double)calib.dig_T3;
+	t_fine = var1 + var2;
+	*temp = t_fine / 5120.0;
+
+	var1 = t_fine / 2.0 - 64000.0;
+	var2 = var1 * var1 * (double)calib.dig_P6 / 32768.0;
+	var2 = var2 + var1 * (double)calib.dig_P5 * 2.0;
+	var2 = var2 / 4.0 + (double)calib.dig_P4 * 65536.0;
+	var1 = ((double)calib.dig_P3 * var1 * var1 / 524288.0 + (double)calib.dig_P2 * var1) / 524288.0;
+	var1 = (1.0 + var1 / 32768.0) * (double)calib.dig_P1;
+	if(var1 == 0.0)
+	{
+		*pressure = 0;
+	}
+	else
+	{
+		p = 1048576.0 - (double)adc_P;
+		p = (p - var2 / 4096.0) * 6250.0 / var1;
+		var1 = (double)calib.dig_P9 * p * p / 2147483648.0;
+		var2 = p * (double)calib.dig_P8 / 32768.0;
+		*pressure = p + (var1 + var2 + (double)calib.dig_P7) / 16.0;
+	}
+
+	var1 = t_fine - 76800.0;
+	var2 = (double)calib.dig_H4 * 64.0 + (double)calib.dig_H5 / 16384.0 * var1;
+	var3 = (double)adc_H - var2;
+	var4 = (double)calib.dig_H2 / 65536.0;
+	var5 = 1.0 + (double)calib.dig_H3 / 67108864.0 * var1;
+	var6 = 1.0 + (double)calib.dig_H6 / 67108864.0 * var1 * var5;
+	h = var3 * var4 * var5 * var6;
+	h = h * (1.0 - (double)calib.dig_H1 * h / 524288.0);
+	*hum = (h > 100.0) ? 100.0 : (h < 0.0) ? 0.0 : h;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Temperature and pressure as printed in the datasheet, pressure with
+ 	 	 the library 64 bit division
+ @param: adc_P, adc_T: Raw values
+ @return:Pa in Q24.8
+ @Reference: BME280 datasheet section 4.2.3
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static uint32_t pressure_datasheet(int32_t adc_P, int32_t adc_T)
+{
+	int32_t t1 = ((((adc_T>>3) - ((int32_t)calib.dig_T1<<1))) * ((int32_t)calib.dig_T2)) >> 11;
+	int32_t t2 = (((((adc_T>>4) - ((int32_t)calib.dig_T1)) * ((adc_T>>4) - ((int32_t)calib.dig_T1))) >> 12) *
+				 ((int32_t)calib.dig_T3)) >> 14;
+	int64_t var1, var2, p;
+
+	var1 = ((int64_t)(t1 + t2)) - 128000;
+	var2 = var1 * var1 * (int64_t)calib.dig_P6;
+	var2 = var2 + ((var1 * (int64_t)calib.dig_P5)<<17);
+	var2 = var2 + (((int64_t)calib.dig_P4)<<35);
+	var1 = ((var1 * var1 * (int64_t)calib.dig_P3)>>8) + ((var1 * (int64_t)calib.dig_P2)<<12);
+	var1 = (((((int64_t)1)<<47)+var1))*((int64_t)calib.dig_P1)>>33;
+	if(var1 == 0)
+	{
+		return 0;
+	}
+	p = 1048576 - adc_P;
+	p = (((p<<31) - var2)*3125)/var1;
+	var1 = (((int64_t)calib.dig_P9) * (p>>13) * (p>>13)) >> 25;
+	var2 = (((int64_t)calib.dig_P8) * p) >> 19;
+
+	return (uint32_t)(((p + var1 + var2) >> 8) + (((int64_t)calib.dig_P7)<<4));
+}
+
+int main(int argc, char** argv)
+{
+	int rounds = (argc > 1) ? atoi(argv[1]) : BENCH_ROUNDS;
+	double start, float_s, scalar_s, batch_s;
+	uint64_t cycles_start, float_cycles, scalar_cycles, batch_cycles;
+	int mismatches = 0;
+	int strays = 0;
+
+	srand(3);
+	for(int i = 0; i < BENCH_FRAMES; i++)
+	{
+		adc_T[i] = 380000 + rand() % 280000;
+		adc_P[i] = 230000 + rand() % 380000;
+		adc_H[i] = 20000 + rand() % 20000;
+		pressure_div[i] = pressure_datasheet(adc_P[i], adc_T[i]);
+	}
+
+	start = now_s();
+	cycles_start = now_cycles();
+	for(int r = 0; r < rounds; r++)
+	{
+		for(int i = 0; i < BENCH_FRAMES; i++)
+		{
+			compensate_float(adc_P[i], adc_T[i], adc_H[i], &temp_float[i], &pressure_float[i], &hum_float[i]);
+		}
+		sink = (uint32_t)pressure_float[r % BENCH_FRAMES];
+	}
+	float_cycles = now_cycles() - cycles_start;
+	float_s = now_s() - start;
+
+	start = now_s();
+	cycles_start = now_cycles();
+	for(int r = 0; r < rounds; r++)
+	{
+		for(int i = 0; i < BENCH_FRAMES; i++)
+		{
+			const bme280_raw_t raw = {.adc_P = adc_P[i], .adc_T = adc_T[i], .adc_H = adc_H[i]};
+			bme280_result_t result;
+
+			bme280_compensate(&raw, &calib, &result);
+			temp_val[i] = result.temp_val;
+			pressure_val[i] = result.pressure_val;
+			hum_val[i] = result.hum_val;
+		}
+		sink = pressure_val[r % BENCH_FRAMES];
+	}
+	scalar_cycles = now_cycles() - cycles_start;
+	scalar_s = now_s() - start;
+
+	for(int i = 0; i < BENCH_FRAMES; i++)
+	{
+		mismatches += (pressure_val[i] != pressure_div[i]);
+		strays += fabs(temp_val[i] / 100.0 - temp_float[i]) > TEMP_TOLERANCE;
+		strays += fabs(pressure_val[i] / 256.0 - pressure_float[i]) > PRESSURE_TOLERANCE;
+		strays += fabs(hum_val[i] / 1024.0 - hum_float[i]) > HUMIDITY_TOLERANCE;
+	}
+
+	const bme280_raw_soa_t raw_soa = {adc_P, adc_T, adc_H};
+	bme280_result_soa_t result_soa = {temp_val, pressure_val, hum_val};
+
+	start = now_s();
+	cycles_start = now_cycles();
+	for(int r = 0; r < rounds; r++)
+	{
+		bme280_compensate_batch(&raw_soa, &calib, &result_soa, BENCH_FRAMES);
+		sink = pressure_val[r % BENCH_FRAMES];
+	}
+	batch_cycles = now_cycles() - cycles_start;
+	batch_s = now_s() - start;
+
+	for(int i = 0; i < BENCH_FRAMES; i++)
+	{
+		mismatches += (pressure_val[i] != pressure_div[i]);
+	}
+
+	double frames = (double)rounds * BENCH_FRAMES;
+	printf("datasheet floating point: %6.2f Mframes/s %6.1f cycles/frame\n", frames / float_s / 1e6, float_cycles / frames);
+	printf("bme280_compensate:        %6.2f Mframes/s %6.1f cycles/frame (x%.2f)\n",
+		   frames / scalar_s / 1e6, scalar_cycles / frames, float_s / scalar_s);
+	printf("bme280_compensate_batch:  %6.2f Mframes/s %6.1f cycles/frame (x%.2f)\n",
+		   frames / batch_s / 1e6, batch_cycles / frames, float_s / batch_s);
+	CHECK_EQ(mismatches, 0);
+	CHECK_EQ(strays, 0);
+
+	return TEST_RESULT();
+}
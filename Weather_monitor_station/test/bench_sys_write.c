@@ -0,0 +1,147 @@
+/***********************************************************************************
+* @file bench_sys_write.c
+ * @brief:Bytes per second through the console write path on the host:
+ *        __sys_write, which hands printf's buffer to cbfifo_enqueue_n in one
+ *        call, against the byte at a time loop it replaced, one
+ *        cbfifo_enqueue and one TIE write per byte. Console lines are
+ *        written until the next one would not fit, then the ring is drained
+ *        in bulk the way UART0_IRQHandler would empty it, so both sides pay
+ *        the same drain. Fails if a line comes out changed or a write is
+ *        refused. Pass a round count to run longer than the ctest run.
+ * @author Sayali Mule
+ * @date 12/04/2021
+ * @Reference:
+ *****************************************************************************/
+//***********************************************************************************
+//                              Include files
+//***********************************************************************************
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "reg_access.h"
+#include "uart.h"
+#include "test_util.h"
+
+//***********************************************************************************
+//                                  Macros
+//***********************************************************************************
+#define BENCH_ROUNDS		(20000) //Default for the ctest run
+#define LINE_LEN			(60) //Typical console line, as in the sensor report
+
+int __sys_write(int handle, char *buf, int size);
+
+//***********************************************************************************
+//                              Global variables
+//***********************************************************************************
+static char line[LINE_LEN];
+static char drained[UART0_TX_FIFO_LEN];
+static int corrupted = 0;
+static int refused = 0;
+
+//***********************************************************************************
+//                                  Function definition
+//***********************************************************************************
+static double now_s(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: __sys_write as it was before cbfifo_enqueue_n, one byte per call
+ @param: handle: Unused
+ 	 	 buf: Bytes to write
+ 	 	 size: Number of bytes
+ @return:0 on success, -1 if the ring filled up
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static int sys_write_per_byte(int handle, char *buf, int size)
+{
+	int status = 0;
+
+	(void)handle;
+
+	for(int i = 0; i < size; i++)
+	{
+		if(cbfifo_enqueue(&uart0_tx_fifo, &buf[i]) != CB_INSTANCE_SUCCESS)
+		{
+			status = -1;
+			break;
+		}
+
+		UART0->C2 |= UART0_C2_TIE(1); //transmit interrupt enable
+	}
+
+	return status;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Empty the console ring in one copy and check every line in it
+ @param: None
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void drain(void)
+{
+	size_t len = cbfifo_dequeue_n(&uart0_tx_fifo, drained, sizeof(drained));
+
+	for(size_t pos = 0; pos < len; pos += LINE_LEN)
+	{
+		corrupted += (memcmp(&drained[pos], line, LINE_LEN) != 0);
+	}
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Write console lines through one write path
+ @param: write: Path under test
+ 	 	 rounds: Number of times the ring is filled and drained
+ @return:Bytes per second
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static double run(int (*write)(int, char*, int), int rounds)
+{
+	const int lines = UART0_TX_FIFO_LEN / LINE_LEN;
+	double start = now_s();
+
+	for(int r = 0; r < rounds; r++)
+	{
+		for(int i = 0; i < lines; i++)
+		{
+			refused += (write(1, line, LINE_LEN) != 0);
+		}
+		drain();
+	}
+
+	return (double)rounds * lines * LINE_LEN / (now_s() - start);
+}
+
+int main(int argc, char** argv)
+{
+	int rounds = (argc > 1) ? atoi(argv[1]) : BENCH_ROUNDS;
+
+	for(int i = 0; i < LINE_LEN - 2; i++)
+	{
+		line[i] = (char)('A' + i % 26);
+	}
+	line[LINE_LEN - 2] = '\n';
+	line[LINE_LEN - 1] = '\r';
+
+	sim_peripherals_reset();
+	uart0_init();
+
+	double per_byte = run(sys_write_per_byte, rounds);
+	double bulk = run(__sys_write, rounds);
+
+	printf("__sys_write per byte: %7.1f MB/s\n", per_byte / 1e6);
+	printf("__sys_write bulk:     %7.1f MB/s (x%.1f)\n", bulk / 1e6, bulk / per_byte);
+	CHECK_EQ(corrupted, 0);
+	CHECK_EQ(refused, 0);
+	CHECK_EQ(cbfifo_length(&uart0_tx_fifo), 0);
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,304 @@
+/***********************************************************************************
+* @file sim_bme280.c
+ * @brief:Register map model of BME280 sensors. Implements the SPI functions
+ *        bme280.c calls, each call is one chip select cycle on the sensor
+ *        selected by the pin of its chip select. Forced conversions finish
+ *        at once, the data registers hold whatever sim_bme280_set_raw put there.
+ * @author Sayali Mule
+ * @date 12/04/2021
+ * @Reference: BME280 datasheet section 5 and 6.3
+ *****************************************************************************/
+//***********************************************************************************
+//                              Include files
+//***********************************************************************************
+#include <string.h>
+#include "sim_bme280.h"
+
+//***********************************************************************************
+//                                  Macros
+//***********************************************************************************
+#define SIM_MODE_MASK		(0x03)
+
+//***********************************************************************************
+//                              Global variables
+//***********************************************************************************
+static sim_bme280_t sensors[SIM_BME280_MAX];
+static uint8_t num_sensors = 0;
+
+spi_status_e sim_bme280_submit_status = SPI_SUCCESS;
+
+//***********************************************************************************
+//                                  Function definition
+//***********************************************************************************
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Remove every sensor from the bus
+ @param: None
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+void sim_bme280_reset()
+{
+	memset(sensors, 0, sizeof(sensors));
+	num_sensors = 0;
+	sim_bme280_submit_status = SPI_SUCCESS;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Put a sensor in its power on state on the bus
+ @param: pin: Chip select pin of the sensor
+ 	 	 calib: Trimming parameters, stored in NVM layout (datasheet table 16)
+ @return:Sensor model, NULL if the bus is full
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+sim_bme280_t* sim_bme280_attach(uint8_t pin, const bme280_calib_t* calib)
+{
+	if(num_sensors == SIM_BME280_MAX)
+	{
+		return NULL;
+	}
+
+	sim_bme280_t* sensor = &sensors[num_sensors++];
+	uint8_t* r = sensor->regs;
+
+	memset(sensor, 0, sizeof(*sensor));
+	sensor->pin = pin;
+
+	const uint16_t tp[12] =
+	{
+		calib->dig_T1, (uint16_t)calib->dig_T2, (uint16_t)calib->dig_T3,
+		calib->dig_P1, (uint16_t)calib->dig_P2, (uint16_t)calib->dig_P3,
+		(uint16_t)calib->dig_P4, (uint16_t)calib->dig_P5, (uint16_t)calib->dig_P6,
+		(uint16_t)calib->dig_P7, (uint16_t)calib->dig_P8, (uint16_t)calib->dig_P9
+	};
+	for(uint8_t i = 0; i < 12; i++)
+	{
+		r[BME280_DIG_T1_LSB_REG + 2 * i] = tp[i] & 0xFF;
+		r[BME280_DIG_T1_LSB_REG + 2 * i + 1] = tp[i] >> 8;
+	}
+
+	r[BME280_DIG_H1_REG] = calib->dig_H1;
+	r[BME280_DIG_H2_LSB_REG] = (uint16_t)calib->dig_H2 & 0xFF;
+	r[BME280_DIG_H2_MSB_REG] = (uint16_t)calib->dig_H2 >> 8;
+	r[BME280_DIG_H3_REG] = calib->dig_H3;
+	r[BME280_DIG_H4_MSB_REG] = ((uint16_t)calib->dig_H4 >> 4) & 0xFF; //H4 is 12 bit, [11:4] and [3:0]
+	r[BME280_DIG_H4_LSB_REG] = ((uint16_t)calib->dig_H4 & 0x0F) | (((uint16_t)calib->dig_H5 & 0x0F) << 4);
+	r[BME280_DIG_H5_MSB_REG] = ((uint16_t)calib->dig_H5 >> 4) & 0xFF; //H5 is 12 bit, [3:0] shares 0xE5
+	r[BME280_DIG_H6_REG] = (uint8_t)calib->dig_H6;
+
+	r[BME280_CHIP_ID_REG] = CHIP_REV;
+	r[BME280_PRESSURE_MSB_REG] = 0x80; //Reset values of the data registers
+	r[BME280_TEMPERATURE_MSB_REG] = 0x80;
+	r[BME280_HUMIDITY_MSB_REG] = 0x80;
+
+	return sensor;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Load the data registers with the result of a conversion
+ @param: sensor: Sensor model
+ 	 	 raw: ADC values, 20 bit pressure and temperature, 16 bit humidity
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+void sim_bme280_set_raw(sim_bme280_t* sensor, const bme280_raw_t* raw)
+{
+	uint8_t* r = &sensor->regs[BME280_MEASUREMENTS_REG];
+
+	r[0] = (raw->adc_P >> 12) & 0xFF;
+	r[1] = (raw->adc_P >> 4) & 0xFF;
+	r[2] = (raw->adc_P & 0x0F) << 4;
+	r[3] = (raw->adc_T >> 12) & 0xFF;
+	r[4] = (raw->adc_T >> 4) & 0xFF;
+	r[5] = (raw->adc_T & 0x0F) << 4;
+	r[6] = (raw->adc_H >> 8) & 0xFF;
+	r[7] = raw->adc_H & 0xFF;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Zero the access counters and the log of a sensor
+ @param: sensor: Sensor model
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+void sim_bme280_clear_log(sim_bme280_t* sensor)
+{
+	sensor->transactions = 0;
+	sensor->calib_reads = 0;
+	sensor->conversions = 0;
+	sensor->log_len = 0;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Find the sensor selected by a chip select
+ @param: cs: Chip select driven low
+ @return:Sensor model, NULL if nothing answers on that pin
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static sim_bme280_t* select_sensor(const spi_cs_t* cs)
+{
+	for(uint8_t i = 0; i < num_sensors; i++)
+	{
+		if(sensors[i].pin == cs->pin)
+		{
+			return &sensors[i];
+		}
+	}
+
+	return NULL;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Book keeping of one chip select cycle
+ @param: sensor: Sensor model
+ 	 	 reg: First register accessed
+ 	 	 length: Registers accessed
+ 	 	 value: Value written or first value read
+ 	 	 write: 1 for a write
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void log_access(sim_bme280_t* sensor, uint8_t reg, uint8_t length, uint8_t value, uint8_t write)
+{
+	uint16_t last = reg + length - 1;
+
+	sensor->transactions++;
+	if(!write && ((reg <= BME280_DIG_H1_REG && last >= BME280_DIG_T1_LSB_REG) ||
+				  (reg <= BME280_DIG_H6_REG && last >= BME280_DIG_H2_LSB_REG)))
+	{
+		sensor->calib_reads++;
+	}
+
+	if(sensor->log_len < SIM_BME280_LOG_LEN)
+	{
+		sim_bme280_access_t* entry = &sensor->log[sensor->log_len];
+		entry->reg = reg;
+		entry->value = value;
+		entry->length = length;
+		entry->write = write;
+	}
+	sensor->log_len++;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Write one register the way the sensor does. A forced conversion
+ 	 	 completes at once and the sensor is back in sleep mode.
+ @param: sensor: Sensor model
+ 	 	 reg: Register address, read bit cleared
+ 	 	 data: Value written
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void write_reg(sim_bme280_t* sensor, uint8_t reg, uint8_t data)
+{
+	reg |= 0x80; //Bit 7 is the direction bit on SPI, registers live at 0x80 and up
+
+	if(reg == BME280_CTRL_MEAS_REG && ((data & SIM_MODE_MASK) == MODE_FORCED || (data & SIM_MODE_MASK) == 0x02))
+	{
+		sensor->conversions++;
+		data &= ~SIM_MODE_MASK;
+	}
+
+	sensor->regs[reg] = data;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: spi.c API, each call is one chip select cycle on the selected sensor
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+void SPI_write_register(const spi_cs_t* cs, uint8_t reg_addr, uint8_t data)
+{
+	sim_bme280_t* sensor = select_sensor(cs);
+
+	if(sensor != NULL)
+	{
+		log_access(sensor, reg_addr | 0x80, 1, data, 1);
+		write_reg(sensor, reg_addr, data);
+	}
+}
+
+void SPI_multibyte_read_register(const spi_cs_t* cs, uint8_t reg_addr, uint8_t* read_data, uint8_t num_regs)
+{
+	sim_bme280_t* sensor = select_sensor(cs);
+
+	if(sensor == NULL)
+	{
+		memset(read_data, 0xFF, num_regs); //MISO floats high
+		return;
+	}
+
+	for(uint8_t i = 0; i < num_regs; i++)
+	{
+		read_data[i] = sensor->regs[(uint8_t)((reg_addr | 0x80) + i)];
+	}
+	log_access(sensor, reg_addr | 0x80, num_regs, read_data[0], 0);
+}
+
+void SPI_read_register(const spi_cs_t* cs, uint8_t reg_addr, uint8_t* read_data)
+{
+	SPI_multibyte_read_register(cs, reg_addr, read_data, 1);
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Queued transfer, done at once and completed before returning.
+ 	 	 First byte is the address, a read clocks 0xFF in while it is sent.
+ @param: txn: Transaction
+ @return:sim_bme280_submit_status, nothing is transferred unless it is SPI_SUCCESS
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+spi_status_e spi_submit(spi_txn_t* txn)
+{
+	if(txn == NULL || txn->cs == NULL || txn->length == 0 || txn->length > 256)
+	{
+		return SPI_ERROR;
+	}
+	if(sim_bme280_submit_status != SPI_SUCCESS)
+	{
+		return sim_bme280_submit_status;
+	}
+
+	uint8_t addr = (txn->tx_data != NULL) ? txn->tx_data[0] : 0xFF;
+	uint8_t data[256];
+
+	if(addr & 0x80)
+	{
+		data[0] = 0xFF;
+		SPI_multibyte_read_register(txn->cs, addr, &data[1], (uint8_t)(txn->length - 1));
+		if(txn->rx_data != NULL)
+		{
+			memcpy(txn->rx_data, data, txn->length);
+		}
+	}
+	else if(txn->length > 1)
+	{
+		SPI_write_register(txn->cs, addr, txn->tx_data[1]);
+	}
+
+	txn->latency_us = 0;
+	if(txn->callback != NULL)
+	{
+		txn->callback(txn->ctx, SPI_SUCCESS);
+	}
+
+	return SPI_SUCCESS;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Nothing to stop, spi_submit completes every transaction before it returns
+ @param: None
+ @return:Transactions dropped, always 0
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+uint8_t spi_abort()
+{
+	return 0;
+}
@@ -0,0 +1,57 @@
+/***********************************************************************************
+* @file sim_bme280.h
+ * @brief:Register map model of BME280 sensors for the host tests. It replaces
+ *        the register level SPI API of spi.c, so bme280.c runs unchanged and
+ *        every chip select cycle it costs can be counted and inspected.
+ * @author Sayali Mule
+ * @date 12/04/2021
+ * @Reference: BME280 datasheet section 5 and 6.3
+ *****************************************************************************/
+#ifndef SIM_BME280_H_
+#define SIM_BME280_H_
+//***********************************************************************************
+//                              Include files
+//***********************************************************************************
+#include <stdint.h>
+#include "bme280.h"
+
+//***********************************************************************************
+//                                  Macros
+//***********************************************************************************
+#define SIM_BME280_MAX			(BME280_MAX_DEVICES)
+#define SIM_BME280_LOG_LEN		(32) //Accesses kept per sensor, later ones are only counted
+
+//One chip select cycle seen by a sensor
+typedef struct
+{
+	uint8_t reg; //First register accessed, read bit cleared
+	uint8_t value; //Value written, first register value read
+	uint8_t length; //Registers accessed
+	uint8_t write; //1 for a write, 0 for a read
+}sim_bme280_access_t;
+
+//State of one simulated sensor
+typedef struct
+{
+	uint8_t pin; //Chip select pin the sensor answers to
+	uint8_t regs[256]; //Register map, indexed by register address
+	uint32_t transactions; //Chip select cycles
+	uint32_t calib_reads; //Chip select cycles that touched the trimming registers
+	uint32_t conversions; //Forced conversions started
+	uint32_t log_len; //Accesses since the last sim_bme280_clear_log
+	sim_bme280_access_t log[SIM_BME280_LOG_LEN];
+}sim_bme280_t;
+
+//***********************************************************************************
+//                              Global variables
+//***********************************************************************************
+extern spi_status_e sim_bme280_submit_status; //Returned by spi_submit, SPI_SUCCESS after reset
+
+//***********************************************************************************
+//                                  Function Prototype
+//***********************************************************************************
+void sim_bme280_reset();
+sim_bme280_t* sim_bme280_attach(uint8_t pin, const bme280_calib_t* calib);
+void sim_bme280_set_raw(sim_bme280_t* sensor, const bme280_raw_t* raw);
+void sim_bme280_clear_log(sim_bme280_t* sensor);
+#endif /* SIM_BME280_H_ */
@@ -0,0 +1,261 @@
+/***********************************************************************************
+* @file test_bme280.c
+ * @brief:Driver level test of bme280.c against the register map model of
+ *        sim_bme280.c. Counts the chip select cycles of init and of every
+ *        sample, checks that the trimming registers are read once only and
+ *        that a configuration is applied in the minimum write sequence.
+ *        The timing and current of the use-case profiles are compared with
+ *        the datasheet.
+ * @author Sayali Mule
+ * @date 12/04/2021
+ * @Reference:
+ *****************************************************************************/
+//***********************************************************************************
+//                              Include files
+//***********************************************************************************
+#include "sim_bme280.h"
+#include "test_util.h"
+
+//***********************************************************************************
+//                                  Macros
+//***********************************************************************************
+#define SAMPLES		(10)
+#define MINUTE_US	(60000000UL)
+#define SECOND_US	(1000000UL)
+
+//Datasheet figures of the use-case profiles
+typedef struct
+{
+	bme280_profile_e profile;
+	uint32_t t_max_us; //Section 9.1 formula, t_measure,max
+	uint32_t period_us; //Forced mode sampling period, ignored in normal mode
+	uint32_t current_nA; //Section 1 and 3.5
+}profile_case_t;
+
+static const profile_case_t profile_cases[] =
+{
+	{BME280_PROFILE_WEATHER_MONITORING, 9300, MINUTE_US, 160},
+	{BME280_PROFILE_WEATHER_MONITORING, 9300, SECOND_US, 3600},
+	{BME280_PROFILE_HUMIDITY_SENSING, 6425, SECOND_US, 1800},
+	{BME280_PROFILE_INDOOR_NAVIGATION, 46100, 0, 633000},
+	{BME280_PROFILE_GAMING, 13325, 0, 581000},
+};
+#define CURRENT_TOL_PERCENT		(15) //Model ignores the SPI access and wake up
+
+//Trimming values of a production part
+static const bme280_calib_t calib_a =
+{
+	.dig_T1 = 27504, .dig_T2 = 26435, .dig_T3 = -1000,
+	.dig_P1 = 36477, .dig_P2 = -10685, .dig_P3 = 3024, .dig_P4 = 2855, .dig_P5 = 140,
+	.dig_P6 = -7, .dig_P7 = 15500, .dig_P8 = -14600, .dig_P9 = 6000,
+	.dig_H1 = 75, .dig_H2 = 362, .dig_H3 = 0, .dig_H4 = 313, .dig_H5 = 50, .dig_H6 = 30
+};
+
+//Second part, every field differs from calib_a and negative 12 bit H4/H5
+static const bme280_calib_t calib_b =
+{
+	.dig_T1 = 28485, .dig_T2 = 26735, .dig_T3 = 50,
+	.dig_P1 = 36738, .dig_P2 = -10635, .dig_P3 = 3025, .dig_P4 = 6980, .dig_P5 = -4,
+	.dig_P6 = -8, .dig_P7 = 9900, .dig_P8 = -10230, .dig_P9 = 4285,
+	.dig_H1 = 76, .dig_H2 = 353, .dig_H3 = 1, .dig_H4 = -340, .dig_H5 = -25, .dig_H6 = -30
+};
+
+static const bme280_raw_t raw_a = {.adc_P = 415148, .adc_T = 519888, .adc_H = 28000};
+static const bme280_raw_t raw_b = {.adc_P = 330000, .adc_T = 540000, .adc_H = 31000};
+
+//***********************************************************************************
+//                              Global variables
+//***********************************************************************************
+static uint32_t callbacks = 0;
+
+//***********************************************************************************
+//                                  Function definition
+//***********************************************************************************
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Compare every trimming parameter
+ @param: actual: Parameters parsed by the driver
+ 	 	 expected: Parameters stored in the model
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void check_calib(const bme280_calib_t* actual, const bme280_calib_t* expected)
+{
+	CHECK_EQ(actual->dig_T1, expected->dig_T1);
+	CHECK_EQ(actual->dig_T2, expected->dig_T2);
+	CHECK_EQ(actual->dig_T3, expected->dig_T3);
+	CHECK_EQ(actual->dig_P1, expected->dig_P1);
+	CHECK_EQ(actual->dig_P2, expected->dig_P2);
+	CHECK_EQ(actual->dig_P3, expected->dig_P3);
+	CHECK_EQ(actual->dig_P4, expected->dig_P4);
+	CHECK_EQ(actual->dig_P5, expected->dig_P5);
+	CHECK_EQ(actual->dig_P6, expected->dig_P6);
+	CHECK_EQ(actual->dig_P7, expected->dig_P7);
+	CHECK_EQ(actual->dig_P8, expected->dig_P8);
+	CHECK_EQ(actual->dig_P9, expected->dig_P9);
+	CHECK_EQ(actual->dig_H1, expected->dig_H1);
+	CHECK_EQ(actual->dig_H2, expected->dig_H2);
+	CHECK_EQ(actual->dig_H3, expected->dig_H3);
+	CHECK_EQ(actual->dig_H4, expected->dig_H4);
+	CHECK_EQ(actual->dig_H5, expected->dig_H5);
+	CHECK_EQ(actual->dig_H6, expected->dig_H6);
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Compare a driver result against the compensation of the raw values
+ @param: actual: Values returned by the driver
+ 	 	 raw: Raw values in the data registers
+ 	 	 calib: Trimming values of the sensor
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void check_result(const sensor_val_t* actual, const bme280_raw_t* raw, const bme280_calib_t* calib)
+{
+	bme280_result_t expected;
+
+	bme280_compensate(raw, calib, &expected);
+	CHECK_EQ(actual->temp_val, expected.temp_val);
+	CHECK_EQ(actual->pressure_val, expected.pressure_val);
+	CHECK_EQ(actual->hum_val, expected.hum_val);
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Check one logged register write
+ @param: access: Logged access
+ 	 	 reg: Register expected to be written
+ 	 	 value: Value expected to be written
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void check_write(const sim_bme280_access_t* access, uint8_t reg, uint8_t value)
+{
+	CHECK_EQ(access->write, 1);
+	CHECK_EQ(access->reg, reg);
+	CHECK_EQ(access->value, value);
+}
+
+static void count_callback(void* ctx, spi_status_e status)
+{
+	(void)ctx;
+	CHECK_EQ(status, SPI_SUCCESS);
+	callbacks++;
+}
+
+int main(void)
+{
+	bme280_dev_t devs[2] = {{.cs = {GPIOD, 0}}, {.cs = {GPIOD, 1}}};
+	sensor_val_t val[2];
+
+	sim_bme280_reset();
+	sim_bme280_t* sensor_a = sim_bme280_attach(0, &calib_a);
+	sim_bme280_t* sensor_b = sim_bme280_attach(1, &calib_b);
+	sim_bme280_set_raw(sensor_a, &raw_a);
+	sim_bme280_set_raw(sensor_b, &raw_b);
+
+	//Init loads the trimming values, two bursts and nothing else
+	CHECK_EQ(bme280_init(&devs[0]), CHIP_REV);
+	CHECK_EQ(bme280_init(&devs[1]), CHIP_REV);
+	CHECK_EQ(sensor_a->calib_reads, 2);
+	CHECK_EQ(sensor_b->calib_reads, 2);
+	check_calib(bme280_get_calibration(&devs[0]), &calib_a);
+	check_calib(bme280_get_calibration(&devs[1]), &calib_b);
+
+	//Every sample is a single burst of the data registers, trimming values come from the cache
+	sim_bme280_clear_log(sensor_a);
+	for(int i = 0; i < SAMPLES; i++)
+	{
+		read_sensors(&devs[0], &val[0]);
+	}
+	CHECK_EQ(sensor_a->transactions, SAMPLES);
+	CHECK_EQ(sensor_a->calib_reads, 0);
+	CHECK_EQ(sensor_a->log[0].reg, BME280_MEASUREMENTS_REG);
+	CHECK_EQ(sensor_a->log[0].length, BME280_MEASUREMENTS_LEN);
+	check_result(&val[0], &raw_a, &calib_a);
+
+	//Each sensor uses its own trimming values
+	sim_bme280_clear_log(sensor_a);
+	sim_bme280_clear_log(sensor_b);
+	read_sensors_all(devs, val, 2);
+	CHECK_EQ(sensor_a->transactions, 1);
+	CHECK_EQ(sensor_b->transactions, 1);
+	check_result(&val[0], &raw_a, &calib_a);
+	check_result(&val[1], &raw_b, &calib_b);
+
+	//Queued read costs the same single burst
+	sim_bme280_clear_log(sensor_b);
+	CHECK_EQ(bme280_start_read(&devs[1], count_callback, NULL), SPI_SUCCESS);
+	CHECK_EQ(callbacks, 1);
+	bme280_raw_t raw;
+	bme280_finish_read(&devs[1], &raw);
+	bme280_compensate(&raw, bme280_get_calibration(&devs[1]), &val[1]);
+	CHECK_EQ(raw.adc_T, raw_b.adc_T);
+	CHECK_EQ(raw.adc_P, raw_b.adc_P);
+	CHECK_EQ(raw.adc_H, raw_b.adc_H);
+	CHECK_EQ(sensor_b->transactions, 1);
+	CHECK_EQ(sensor_b->calib_reads, 0);
+	check_result(&val[1], &raw_b, &calib_b);
+
+	//Init from power on: 2 trimming bursts, 1 control register burst, 3 writes, chip id
+	bme280_dev_t dev = {.cs = {GPIOD, 2}};
+	sim_bme280_t* sensor_c = sim_bme280_attach(2, &calib_a);
+	bme280_init(&dev);
+	CHECK_EQ(sensor_c->transactions, 7);
+	CHECK_EQ(sensor_c->conversions, 0);
+
+	//From sleep mode: ctrl_hum, config, ctrl_meas and nothing else
+	bme280_config_t config = {.osrs_t = 2, .osrs_p = 16, .osrs_h = 1, .filter = 4, .standby = 5, .mode = MODE_NORMAL};
+	sim_bme280_clear_log(sensor_c);
+	bme280_apply_config(&dev, &config);
+	CHECK_EQ(sensor_c->transactions, 3);
+	check_write(&sensor_c->log[0], BME280_CTRL_HUMIDITY_REG, 0x01);
+	check_write(&sensor_c->log[1], BME280_CONFIG_REG, (5 << 5) | (4 << 2));
+	check_write(&sensor_c->log[2], BME280_CTRL_MEAS_REG, (2 << 5) | (5 << 2) | MODE_NORMAL);
+
+	//From normal mode one extra write puts the sensor to sleep first
+	config.osrs_p = 1;
+	config.filter = 0;
+	config.mode = MODE_SLEEP;
+	sim_bme280_clear_log(sensor_c);
+	bme280_apply_config(&dev, &config);
+	CHECK_EQ(sensor_c->transactions, 4);
+	check_write(&sensor_c->log[0], BME280_CTRL_MEAS_REG, (2 << 5) | (1 << 2) | MODE_SLEEP);
+	check_write(&sensor_c->log[1], BME280_CTRL_HUMIDITY_REG, 0x01);
+	check_write(&sensor_c->log[2], BME280_CONFIG_REG, (5 << 5));
+	check_write(&sensor_c->log[3], BME280_CTRL_MEAS_REG, (2 << 5) | (1 << 2) | MODE_SLEEP);
+	CHECK_EQ(sensor_c->regs[BME280_CTRL_MEAS_REG], (2 << 5) | (1 << 2));
+	CHECK_EQ(get_mode(&dev), MODE_SLEEP);
+
+	//Forced conversion is a single write, the shadow copy already reads back sleep
+	sim_bme280_clear_log(sensor_c);
+	bme280_trigger_forced(&dev);
+	CHECK_EQ(sensor_c->transactions, 1);
+	CHECK_EQ(sensor_c->conversions, 1);
+	CHECK_EQ(get_mode(&dev), MODE_SLEEP);
+
+	//Profile timing and current against the datasheet
+	for(size_t i = 0; i < sizeof(profile_cases) / sizeof(profile_cases[0]); i++)
+	{
+		const profile_case_t* expected = &profile_cases[i];
+		const bme280_config_t* config = bme280_get_profile(expected->profile);
+		uint32_t current_nA = bme280_config_average_current_nA(config, expected->period_us);
+
+		printf("Profile %d: t_max %u us, %u nA\n", expected->profile, bme280_config_conversion_time_us(config), current_nA);
+		CHECK_EQ(bme280_config_conversion_time_us(config), expected->t_max_us);
+		CHECK(current_nA * 100 >= expected->current_nA * (100 - CURRENT_TOL_PERCENT));
+		CHECK(current_nA * 100 <= expected->current_nA * (100 + CURRENT_TOL_PERCENT));
+	}
+
+	//Station keeps the weather monitoring profile, more oversampling is not picked on its own
+	CHECK_EQ(bme280_select_profile(BME280_PROFILE_WEATHER_MONITORING, MINUTE_US, 10000), BME280_PROFILE_WEATHER_MONITORING);
+	CHECK_EQ(bme280_select_profile(BME280_PROFILE_WEATHER_MONITORING, SECOND_US, 10000), BME280_PROFILE_WEATHER_MONITORING);
+	CHECK(!bme280_profile_fits(BME280_PROFILE_WEATHER_MONITORING, 5000, 10000)); //Period shorter than conversion
+	CHECK(!bme280_profile_fits(BME280_PROFILE_WEATHER_MONITORING, SECOND_US, 1000)); //Over budget
+
+	//Indoor navigation over budget falls back to the cheapest profile measuring T, P and H
+	CHECK_EQ(bme280_select_profile(BME280_PROFILE_INDOOR_NAVIGATION, SECOND_US, 10000), BME280_PROFILE_WEATHER_MONITORING);
+	CHECK_EQ(bme280_select_profile(BME280_PROFILE_INDOOR_NAVIGATION, SECOND_US, 1000000), BME280_PROFILE_INDOOR_NAVIGATION);
+
+	return TEST_RESULT();
+}
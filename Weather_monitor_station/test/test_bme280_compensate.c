@@ -0,0 +1,223 @@
+/***********************************************************************************
+* @file test_bme280_compensate.c
+ * @brief:Checks the integer compensation of bme280_compensate.c against the
+ *        worked example of the datasheet and against the double precision
+ *        reference formulas over the whole operating range. Pressure
+ *        must match the 64 bit division of the datasheet formula to the
+ *        bit, and the batch version the single frame version.
+ * @author Sayali Mule
+ * @date 12/04/2021
+ * @Reference: BME280 datasheet section 4.2.3 and 8.1,
+ *             BMP280 datasheet section 3.12 (worked example)
+ *****************************************************************************/
+//***********************************************************************************
+//                              Include files
+//***********************************************************************************
+#include <math.h>
+#include <stdlib.h>
+#include "bme280_compensate.h"
+#include "test_util.h"
+
+//***********************************************************************************
+//                                  Macros
+//***********************************************************************************
+#define SWEEP_FRAMES		(1003) //Not a multiple of BME280_BATCH_CHUNK
+#define TEMP_TOL			(1) //0.01 DegC
+#define PRES_TOL_PA			(1.0)
+#define HUM_TOL_RH			(0.01)
+#define DIVISION_FRAMES		(200000)
+
+//Trimming values of the worked example, humidity from a production part
+static const bme280_calib_t calib =
+{
+	.dig_T1 = 27504, .dig_T2 = 26435, .dig_T3 = -1000,
+	.dig_P1 = 36477, .dig_P2 = -10685, .dig_P3 = 3024, .dig_P4 = 2855, .dig_P5 = 140,
+	.dig_P6 = -7, .dig_P7 = 15500, .dig_P8 = -14600, .dig_P9 = 6000,
+	.dig_H1 = 75, .dig_H2 = 362, .dig_H3 = 0, .dig_H4 = 313, .dig_H5 = 50, .dig_H6 = 30
+};
+
+//***********************************************************************************
+//                                  Function definition
+//***********************************************************************************
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Double precision compensation as given in the datasheet
+ @param: raw: Raw ADC values
+ 	 	 t, p, h: DegC, Pa and %RH
+ @return:None
+ @Reference: BME280 datasheet section 8.1
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void compensate_double(const bme280_raw_t* raw, double* t, double* p, double* h)
+{
+	double var1, var2, t_fine;
+
+	var1 = (raw->adc_T / 16384.0 - calib.dig_T1 / 1024.0) * calib.dig_T2;
+	var2 = (raw->adc_T / 131072.0 - calib.dig_T1 / 8192.0) * (raw->adc_T / 131072.0 - calib.dig_T1 / 8192.0) * calib.dig_T3;
+	t_fine = var1 + var2;
+	*t = t_fine / 5120.0;
+
+	var1 = t_fine / 2.0 - 64000.0;
+	var2 = var1 * var1 * calib.dig_P6 / 32768.0;
+	var2 = var2 + var1 * calib.dig_P5 * 2.0;
+	var2 = var2 / 4.0 + calib.dig_P4 * 65536.0;
+	var1 = (calib.dig_P3 * var1 * var1 / 524288.0 + calib.dig_P2 * var1) / 524288.0;
+	var1 = (1.0 + var1 / 32768.0) * calib.dig_P1;
+	*p = 1048576.0 - raw->adc_P;
+	*p = (*p - var2 / 4096.0) * 6250.0 / var1;
+	var1 = calib.dig_P9 * *p * *p / 2147483648.0;
+	var2 = *p * calib.dig_P8 / 32768.0;
+	*p = *p + (var1 + var2 + calib.dig_P7) / 16.0;
+
+	*h = t_fine - 76800.0;
+	*h = (raw->adc_H - (calib.dig_H4 * 64.0 + calib.dig_H5 / 16384.0 * *h)) *
+		 (calib.dig_H2 / 65536.0 * (1.0 + calib.dig_H6 / 67108864.0 * *h * (1.0 + calib.dig_H3 / 67108864.0 * *h)));
+	*h = *h * (1.0 - calib.dig_H1 * *h / 524288.0);
+	*h = (*h > 100.0) ? 100.0 : (*h < 0.0) ? 0.0 : *h;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Fine temperature of the 32 bit integer formula
+ @param: adc_T: Raw temperature
+ 	 	 trim: Trimming parameters
+ @return:t_fine
+ @Reference: BME280 datasheet section 4.2.3
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static int32_t t_fine_datasheet(int32_t adc_T, const bme280_calib_t* trim)
+{
+	int32_t var1 = ((((adc_T>>3) - ((int32_t)trim->dig_T1<<1))) * ((int32_t)trim->dig_T2)) >> 11;
+	int32_t var2 = (((((adc_T>>4) - ((int32_t)trim->dig_T1)) * ((adc_T>>4) - ((int32_t)trim->dig_T1))) >> 12) *
+					((int32_t)trim->dig_T3)) >> 14;
+
+	return var1 + var2;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: 64 bit integer pressure exactly as printed in the datasheet, with
+ 	 	 the library division
+ @param: adc_P: Raw pressure
+ 	 	 trim: Trimming parameters
+ 	 	 t_fine: Fine temperature
+ @return:Pa in Q24.8
+ @Reference: BME280 datasheet section 4.2.3
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static uint32_t pressure_datasheet(int32_t adc_P, const bme280_calib_t* trim, int32_t t_fine)
+{
+	int64_t var1, var2, p;
+	var1 = ((int64_t)t_fine) - 128000;
+	var2 = var1 * var1 * (int64_t)trim->dig_P6;
+	var2 = var2 + ((var1 * (int64_t)trim->dig_P5)<<17);
+	var2 = var2 + (((int64_t)trim->dig_P4)<<35);
+	var1 = ((var1 * var1 * (int64_t)trim->dig_P3)>>8) + ((var1 * (int64_t)trim->dig_P2)<<12);
+	var1 = (((((int64_t)1)<<47)+var1))*((int64_t)trim->dig_P1)>>33;
+	if(var1 == 0)
+	{
+		return 0;
+	}
+	p = 1048576 - adc_P;
+	p = (((p<<31) - var2)*3125)/var1;
+	var1 = (((int64_t)trim->dig_P9) * (p>>13) * (p>>13)) >> 25;
+	var2 = (((int64_t)trim->dig_P8) * p) >> 19;
+	p = ((p + var1 + var2) >> 8) + (((int64_t)trim->dig_P7)<<4);
+
+	return (uint32_t)p;
+}
+
+int main(void)
+{
+	bme280_result_t result;
+
+	//Worked example: 25.08 DegC and 100653.27 Pa with the float formulas.
+	//The 64 bit integer formula truncates to 25767233/256 = 100653.25 Pa.
+	const bme280_raw_t example = {.adc_P = 415148, .adc_T = 519888, .adc_H = 28000};
+	bme280_compensate(&example, &calib, &result);
+	CHECK_EQ(result.temp_val, 2508);
+	CHECK_EQ(result.pressure_val, 25767233);
+	CHECK(fabs(result.pressure_val / 256.0 - 100653.27) < 0.05);
+
+	//Humidity saturates at both ends of the range
+	const bme280_raw_t dry = {.adc_P = 415148, .adc_T = 519888, .adc_H = 0};
+	const bme280_raw_t wet = {.adc_P = 415148, .adc_T = 519888, .adc_H = 65535};
+	bme280_compensate(&dry, &calib, &result);
+	CHECK_EQ(result.hum_val, 0);
+	bme280_compensate(&wet, &calib, &result);
+	CHECK_EQ(result.hum_val, 100 << 10);
+
+	//Erased NVM must not divide by zero
+	bme280_calib_t blank = calib;
+	blank.dig_P1 = 0;
+	bme280_compensate(&example, &blank, &result);
+	CHECK_EQ(result.pressure_val, 0);
+
+	//Division free pressure against the library division, whole 20 bit ADC
+	//range and trimming values spread around the production part
+	int pressure_mismatches = 0;
+	srand(2);
+	for(int i = 0; i < DIVISION_FRAMES; i++)
+	{
+		bme280_calib_t trim = calib;
+		trim.dig_P1 = (uint16_t)(calib.dig_P1 + rand() % 8192 - 4096);
+		trim.dig_P2 = (int16_t)(calib.dig_P2 + rand() % 2048 - 1024);
+		trim.dig_P4 = (int16_t)(calib.dig_P4 + rand() % 2048 - 1024);
+
+		const bme280_raw_t raw = {.adc_P = rand() % (1 << 20), .adc_T = rand() % (1 << 20), .adc_H = 0};
+
+		bme280_compensate(&raw, &trim, &result);
+		if(result.pressure_val != pressure_datasheet(raw.adc_P, &trim, t_fine_datasheet(raw.adc_T, &trim)))
+		{
+			pressure_mismatches++;
+		}
+	}
+	CHECK_EQ(pressure_mismatches, 0);
+
+	//Sweep of -40..85 DegC, 300..1100 hPa and 0..100 %RH against the float formulas
+	static int32_t adc_P[SWEEP_FRAMES], adc_T[SWEEP_FRAMES], adc_H[SWEEP_FRAMES];
+	static int32_t temp_val[SWEEP_FRAMES];
+	static uint32_t pressure_val[SWEEP_FRAMES], hum_val[SWEEP_FRAMES];
+	double max_err_t = 0, max_err_p = 0, max_err_h = 0;
+
+	srand(1);
+	for(int i = 0; i < SWEEP_FRAMES; i++)
+	{
+		bme280_raw_t raw = {.adc_T = 380000 + rand() % 280000, .adc_P = 230000 + rand() % 380000, .adc_H = 20000 + rand() % 20000};
+		double t, p, h;
+
+		adc_T[i] = raw.adc_T;
+		adc_P[i] = raw.adc_P;
+		adc_H[i] = raw.adc_H;
+
+		bme280_compensate(&raw, &calib, &result);
+		compensate_double(&raw, &t, &p, &h);
+
+		max_err_t = fmax(max_err_t, fabs(result.temp_val / 100.0 - t));
+		max_err_p = fmax(max_err_p, fabs(result.pressure_val / 256.0 - p));
+		max_err_h = fmax(max_err_h, fabs(result.hum_val / 1024.0 - h));
+	}
+	printf("Largest error against float formulas: %.4f DegC, %.4f Pa, %.5f %%RH\n", max_err_t, max_err_p, max_err_h);
+	CHECK(max_err_t <= TEMP_TOL / 100.0);
+	CHECK(max_err_p <= PRES_TOL_PA);
+	CHECK(max_err_h <= HUM_TOL_RH);
+
+	//Batch gives the same bits as one frame at a time
+	const bme280_raw_soa_t raw_soa = {adc_P, adc_T, adc_H};
+	bme280_result_soa_t result_soa = {temp_val, pressure_val, hum_val};
+	int mismatches = 0;
+
+	bme280_compensate_batch(&raw_soa, &calib, &result_soa, SWEEP_FRAMES);
+	for(int i = 0; i < SWEEP_FRAMES; i++)
+	{
+		bme280_raw_t raw = {.adc_P = adc_P[i], .adc_T = adc_T[i], .adc_H = adc_H[i]};
+		bme280_compensate(&raw, &calib, &result);
+		if(result.temp_val != temp_val[i] || result.pressure_val != pressure_val[i] || result.hum_val != hum_val[i])
+		{
+			mismatches++;
+		}
+	}
+	CHECK_EQ(mismatches, 0);
+
+	return TEST_RESULT();
+}
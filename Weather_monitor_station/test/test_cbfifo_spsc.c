@@ -0,0 +1,277 @@
+/***********************************************************************************
+* @file test_cbfifo_spsc.c
+ * @brief:Two thread stress test of the lock-free cbfifo. One thread stands in
+ *        for the ISR and one for the main loop. The producer writes a running
+ *        byte counter with every producer call (single byte, bulk and
+ *        reserve/commit), the consumer reads it back with every consumer call
+ *        and checks that no byte is lost, duplicated or reordered.
+ *        The typed FIFO gets the same treatment with multi-word records.
+ * @author Sayali Mule
+ * @date 12/04/2021
+ * @Reference:
+ *****************************************************************************/
+//***********************************************************************************
+//                              Include files
+//***********************************************************************************
+#include <pthread.h>
+#include <sched.h>
+#include "cbfifo.h"
+#include "cbfifo_typed.h"
+#include "test_util.h"
+
+//***********************************************************************************
+//                                  Macros
+//***********************************************************************************
+#define STRESS_BYTES	(1UL << 23) //Bytes pushed through the byte ring
+#define STRESS_RECORDS	(1UL << 18) //Records pushed through the typed ring
+#define RING_LEN		(64) //Small, so indices wrap often
+
+typedef struct
+{
+	uint32_t seq;
+	uint32_t check; //~seq, catches a record read while half written
+}record_t;
+
+CBFIFO_DEFINE(ring, RING_LEN);
+CBFIFO_TYPED_DEFINE(record_fifo, record_t, 16)
+
+//***********************************************************************************
+//                              Global variables
+//***********************************************************************************
+static record_fifo_t records;
+static unsigned long byte_errors = 0;
+static unsigned long record_errors = 0;
+
+//***********************************************************************************
+//                                  Function definition
+//***********************************************************************************
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Producer thread, cycles through the three ways of enqueueing
+ @param: arg: Unused
+ @return:NULL
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void* byte_producer(void* arg)
+{
+	uint8_t chunk[24];
+	unsigned long sent = 0;
+	unsigned long round = 0;
+
+	(void)arg;
+	while(sent < STRESS_BYTES)
+	{
+		size_t want = 1 + (round % sizeof(chunk));
+		size_t done = 0;
+
+		if(want > STRESS_BYTES - sent)
+		{
+			want = STRESS_BYTES - sent;
+		}
+
+		switch(round % 3)
+		{
+			case 0:
+			{
+				uint8_t byte = (uint8_t)sent;
+				done = (cbfifo_enqueue(&ring, &byte) == CB_INSTANCE_SUCCESS) ? 1 : 0;
+			}
+			break;
+
+			case 1:
+			{
+				for(size_t i = 0; i < want; i++)
+				{
+					chunk[i] = (uint8_t)(sent + i);
+				}
+				done = cbfifo_enqueue_n(&ring, chunk, want);
+			}
+			break;
+
+			default:
+			{
+				cb_span_t span1, span2;
+				done = cbfifo_reserve(&ring, want, &span1, &span2);
+				for(size_t i = 0; i < done; i++)
+				{
+					uint8_t* slot = (i < span1.length) ? &span1.data[i] : &span2.data[i - span1.length];
+					*slot = (uint8_t)(sent + i);
+				}
+				cbfifo_commit(&ring, done);
+			}
+			break;
+		}
+
+		sent += done;
+		round++;
+		if(done == 0)
+		{
+			sched_yield(); //Ring full, let the consumer run
+		}
+	}
+
+	return NULL;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Consumer thread, cycles through the three ways of dequeueing
+ @param: arg: Unused
+ @return:NULL
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void* byte_consumer(void* arg)
+{
+	uint8_t chunk[24];
+	unsigned long received = 0;
+	unsigned long round = 0;
+
+	(void)arg;
+	while(received < STRESS_BYTES)
+	{
+		size_t done = 0;
+
+		switch(round % 3)
+		{
+			case 0:
+			{
+				done = (cbfifo_dequeue(&ring, chunk) == CB_INSTANCE_SUCCESS) ? 1 : 0;
+			}
+			break;
+
+			case 1:
+			{
+				done = cbfifo_dequeue_n(&ring, chunk, 1 + (round % sizeof(chunk)));
+			}
+			break;
+
+			default:
+			{
+				cb_span_t span1, span2;
+				done = cbfifo_peek(&ring, &span1, &span2);
+				if(done > sizeof(chunk))
+				{
+					done = sizeof(chunk);
+				}
+				for(size_t i = 0; i < done; i++)
+				{
+					chunk[i] = (i < span1.length) ? span1.data[i] : span2.data[i - span1.length];
+				}
+				cbfifo_release(&ring, done);
+			}
+			break;
+		}
+
+		for(size_t i = 0; i < done; i++)
+		{
+			if(chunk[i] != (uint8_t)(received + i))
+			{
+				byte_errors++;
+			}
+		}
+
+		received += done;
+		round++;
+		if(done == 0)
+		{
+			sched_yield(); //Ring empty, let the producer run
+		}
+	}
+
+	return NULL;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Producer thread of the typed ring
+ @param: arg: Unused
+ @return:NULL
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void* record_producer(void* arg)
+{
+	(void)arg;
+	for(uint32_t seq = 0; seq < STRESS_RECORDS; )
+	{
+		record_t record = {seq, ~seq};
+		if(record_fifo_enqueue(&records, &record) == CB_INSTANCE_SUCCESS)
+		{
+			seq++;
+		}
+		else
+		{
+			sched_yield();
+		}
+	}
+
+	return NULL;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Consumer thread of the typed ring
+ @param: arg: Unused
+ @return:NULL
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void* record_consumer(void* arg)
+{
+	(void)arg;
+	for(uint32_t seq = 0; seq < STRESS_RECORDS; )
+	{
+		record_t record;
+		if(record_fifo_dequeue(&records, &record) == CB_INSTANCE_SUCCESS)
+		{
+			if(record.seq != seq || record.check != ~seq)
+			{
+				record_errors++;
+			}
+			seq++;
+		}
+		else
+		{
+			sched_yield();
+		}
+	}
+
+	return NULL;
+}
+
+int main(void)
+{
+	pthread_t producer, consumer;
+
+	pthread_create(&consumer, NULL, byte_consumer, NULL);
+	pthread_create(&producer, NULL, byte_producer, NULL);
+	pthread_join(producer, NULL);
+	pthread_join(consumer, NULL);
+
+	CHECK_EQ(byte_errors, 0);
+	CHECK_EQ(cbfifo_length(&ring), 0);
+	CHECK_EQ(ring.stats.total_bytes, STRESS_BYTES);
+	CHECK(ring.stats.peak <= RING_LEN);
+
+	//Only calls that ask the empty ring for data count as empty reads
+	uint8_t byte;
+	cb_span_t span1, span2;
+	uint32_t empty_reads = ring.stats.empty_reads;
+
+	CHECK_EQ(cbfifo_dequeue(&ring, &byte), CB_EMPTY);
+	CHECK_EQ(cbfifo_dequeue_n(&ring, &byte, 1), 0);
+	CHECK_EQ(cbfifo_dequeue_n(&ring, &byte, 0), 0);
+	CHECK_EQ(cbfifo_peek(&ring, &span1, &span2), 0);
+	CHECK_EQ(ring.stats.empty_reads - empty_reads, 2);
+
+	pthread_create(&consumer, NULL, record_consumer, NULL);
+	pthread_create(&producer, NULL, record_producer, NULL);
+	pthread_join(producer, NULL);
+	pthread_join(consumer, NULL);
+
+	CHECK_EQ(record_errors, 0);
+	CHECK_EQ(record_fifo_length(&records), 0);
+
+	printf("%lu bytes and %lu records passed through, %lu and %lu errors\n",
+		   STRESS_BYTES, STRESS_RECORDS, byte_errors, record_errors);
+
+	return TEST_RESULT();
+}
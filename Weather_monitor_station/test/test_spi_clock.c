@@ -0,0 +1,111 @@
+/***********************************************************************************
+* @file test_spi_clock.c
+ * @brief:Checks spi_set_frequency for every clock configuration of
+ *        board/clock_config.c. The chosen SPPR/SPR pair must give the
+ *        fastest SCK not above the request, and the returned frequency must
+ *        be the one programmed in SPI0->BR.
+ * @author Sayali Mule
+ * @date 12/04/2021
+ * @Reference: KL25 Sub-Family Reference Manual section 37.3.3
+ *****************************************************************************/
+//***********************************************************************************
+//                              Include files
+//***********************************************************************************
+#include "reg_access.h"
+#include "clock_config.h"
+#include "spi.h"
+#include "test_util.h"
+
+//***********************************************************************************
+//                                  Macros
+//***********************************************************************************
+#define OUTDIV4(clkdiv1)	((((clkdiv1) >> 16) & 0x07) + 1) //Bus clock divider of SIM_CLKDIV1
+
+//Clock configurations of board/clock_config.c, SIM_CLKDIV1 copied from simConfig_*
+typedef struct
+{
+	const char* name;
+	uint32_t core_hz;
+	uint32_t clkdiv1;
+	uint32_t hz_at_10mhz; //Expected SCK for SPI_DEFAULT_FREQ_HZ
+}clock_case_t;
+
+static const clock_case_t clock_cases[] =
+{
+	{"BOARD_BootClockRUN", BOARD_BOOTCLOCKRUN_CORE_CLOCK, 0x10010000U, 6000000}, //24 MHz bus, divide by 4
+	{"BOARD_BootClockVLPR", BOARD_BOOTCLOCKVLPR_CORE_CLOCK, 0x00040000U, 400000}, //800 kHz bus, divide by 2
+};
+
+static const uint32_t requests_hz[] = {SPI_DEFAULT_FREQ_HZ, 8000000, 5000000, 1000000, 400000, 115200, 10000, 100};
+
+//***********************************************************************************
+//                                  Function definition
+//***********************************************************************************
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: SCK frequency of a baud rate register value
+ @param: bus_hz: Bus clock
+ 	 	 br: SPI0->BR
+ @return:SCK frequency in Hz
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static uint32_t br_to_hz(uint32_t bus_hz, uint8_t br)
+{
+	uint32_t sppr = (br & SPI_BR_SPPR_MASK) >> SPI_BR_SPPR_SHIFT;
+	uint32_t spr = (br & SPI_BR_SPR_MASK) >> SPI_BR_SPR_SHIFT;
+
+	return bus_hz / ((sppr + 1) << (spr + 1));
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Fastest SCK not above the request over every divisor, the slowest
+ 	 	 one if none fits
+ @param: bus_hz: Bus clock
+ 	 	 hz: Requested SCK
+ @return:SCK frequency in Hz
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static uint32_t best_hz(uint32_t bus_hz, uint32_t hz)
+{
+	uint32_t best = 0;
+	uint32_t slowest = bus_hz;
+
+	for(uint32_t prescale = 1; prescale <= 8; prescale++)
+	{
+		for(uint32_t divisor = 2; divisor <= 512; divisor <<= 1)
+		{
+			uint32_t rate = bus_hz / (prescale * divisor);
+			if(rate <= hz && rate > best) best = rate;
+			if(rate < slowest) slowest = rate;
+		}
+	}
+
+	return (best != 0) ? best : slowest;
+}
+
+int main(void)
+{
+	for(size_t c = 0; c < sizeof(clock_cases) / sizeof(clock_cases[0]); c++)
+	{
+		const clock_case_t* clock = &clock_cases[c];
+
+		sim_peripherals_reset();
+		sim_bus_clock_hz = clock->core_hz / OUTDIV4(clock->clkdiv1);
+		spi_init();
+
+		printf("%s: bus %u Hz, SCK %u Hz\n", clock->name, sim_bus_clock_hz, br_to_hz(sim_bus_clock_hz, SPI0->BR));
+		CHECK_EQ(br_to_hz(sim_bus_clock_hz, SPI0->BR), clock->hz_at_10mhz);
+
+		for(size_t r = 0; r < sizeof(requests_hz) / sizeof(requests_hz[0]); r++)
+		{
+			uint32_t achieved = spi_set_frequency(requests_hz[r]);
+
+			CHECK_EQ(achieved, best_hz(sim_bus_clock_hz, requests_hz[r]));
+			CHECK_EQ(br_to_hz(sim_bus_clock_hz, SPI0->BR), achieved);
+			CHECK(achieved <= requests_hz[r] || achieved == sim_bus_clock_hz / 4096); //Slowest is 8 * 512
+		}
+	}
+
+	return TEST_RESULT();
+}
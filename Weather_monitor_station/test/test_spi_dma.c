@@ -0,0 +1,290 @@
+/***********************************************************************************
+* @file test_spi_dma.c
+ * @brief:Runs the SPI transaction queue on the simulated DMA and SPI0, built
+ *        once per queue engine. With SPI_QUEUE_USE_DMA at 1 queued
+ *        transactions are moved by the DMA channels, at 0 by SPI0_IRQHandler
+ *        one byte per interrupt. Checks the channel descriptors, that
+ *        back-to-back queued transactions chain from the completion
+ *        interrupt, and that chip select and the SPI requests are released
+ *        at the end, also when the queue is aborted part way. A queued
+ *        transaction that finds the bus taken by a direct transfer starts
+ *        when that one is done, and a DMA error reaches the callback as
+ *        SPI_BUS_ERROR.
+ * @author Sayali Mule
+ * @date 12/04/2021
+ * @Reference: KL25 Sub-Family Reference Manual chapter 23 (DMA) and 37 (SPI)
+ *****************************************************************************/
+//***********************************************************************************
+//                              Include files
+//***********************************************************************************
+#include <string.h>
+#include "reg_access.h"
+#include "gpio.h"
+#include "spi.h"
+#include "test_util.h"
+
+//***********************************************************************************
+//                                  Macros
+//***********************************************************************************
+#define RX_CH		(SPI_DMA_RX_CHANNEL)
+#define TX_CH		(SPI_DMA_TX_CHANNEL)
+
+void DMA0_IRQHandler(void);
+void SPI0_IRQHandler(void);
+
+//***********************************************************************************
+//                              Global variables
+//***********************************************************************************
+static uint32_t done_mask = 0;
+static spi_status_e last_status = SPI_SUCCESS;
+static uint32_t callbacks = 0;
+
+//***********************************************************************************
+//                                  Function definition
+//***********************************************************************************
+static void txn_done(void* ctx, spi_status_e status)
+{
+	done_mask |= 1UL << (uintptr_t)ctx;
+	last_status = status;
+	callbacks++;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Clock the running transfer through the loopback SPI model.
+ 	 	 DMA: one TX request followed by one RX request per byte, then the
+ 	 	 RX channel interrupt like the NVIC would raise it.
+ 	 	 SPI0 interrupt: one interrupt per byte while SPIE is set, until the
+ 	 	 running transaction completes. The register file hands back the
+ 	 	 byte written to D, SPRF and SPTEF are always set.
+ @param: None
+ @return:Bytes received
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static uint32_t run_transfer(void)
+{
+	uint32_t received = 0;
+
+	if(DMA0->DMA[TX_CH].DCR & DMA_DCR_ERQ_MASK)
+	{
+		while(sim_dma_step(TX_CH))
+		{
+			received += sim_dma_step(RX_CH);
+		}
+
+		if((DMA0->DMA[RX_CH].DSR_BCR & DMA_DSR_BCR_DONE_MASK) && (DMA0->DMA[RX_CH].DCR & DMA_DCR_EINT_MASK))
+		{
+			DMA0_IRQHandler();
+		}
+
+		return received;
+	}
+
+#if !SPI_QUEUE_USE_DMA
+	uint32_t completed = callbacks;
+
+	while((SPI0->C1 & SPI_C1_SPIE_MASK) && callbacks == completed)
+	{
+		SPI0_IRQHandler();
+		received++;
+	}
+#endif
+
+	return received;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Queued transaction is on the bus with the engine under test
+ @param: tx_data, rx_data: Buffers of the transaction
+ 	 	 length: Bytes of the transaction
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void check_queue_running(const uint8_t* tx_data, const uint8_t* rx_data, size_t length)
+{
+#if SPI_QUEUE_USE_DMA
+	CHECK(sim_dma_ptr(DMA0->DMA[TX_CH].SAR) == tx_data);
+	CHECK(sim_dma_ptr(DMA0->DMA[RX_CH].DAR) != NULL);
+	CHECK_EQ(DMA0->DMA[RX_CH].DSR_BCR, length);
+	CHECK_EQ(DMA0->DMA[TX_CH].DSR_BCR, length);
+	CHECK_EQ(!!(DMA0->DMA[RX_CH].DCR & DMA_DCR_DINC_MASK), rx_data != NULL); //Discarded bytes go to one sink
+	CHECK_EQ(SPI0->C2 & (SPI_C2_RXDMAE_MASK | SPI_C2_TXDMAE_MASK), SPI_C2_RXDMAE_MASK | SPI_C2_TXDMAE_MASK);
+	CHECK(!(SPI0->C1 & SPI_C1_SPIE_MASK));
+#else
+	(void)rx_data;
+	(void)length;
+	CHECK(SPI0->C1 & SPI_C1_SPIE_MASK);
+	CHECK_EQ(SPI0->D, tx_data[0]);
+	CHECK_EQ(SPI0->C2 & (SPI_C2_RXDMAE_MASK | SPI_C2_TXDMAE_MASK), 0);
+#endif
+}
+
+int main(void)
+{
+	const spi_cs_t cs = {SPI_CS_PORT, SPI_CS_PIN};
+	const uint8_t burst_tx[9] = {0xF7, 1, 2, 3, 4, 5, 6, 7, 8};
+	uint8_t burst_rx[9] = {0};
+	const uint8_t write_tx[2] = {0x74, 0x25};
+	spi_queue_stats_t stats;
+
+	sim_peripherals_reset();
+	gpio_init();
+	spi_init();
+
+	CHECK_EQ(DMAMUX0->CHCFG[RX_CH], DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(16));
+	CHECK_EQ(DMAMUX0->CHCFG[TX_CH], DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(17));
+	CHECK(sim_irq_enabled_mask & (1UL << DMA0_IRQn));
+	CHECK(sim_irq_enabled_mask & (1UL << SPI0_IRQn));
+
+	spi_txn_t read = {.cs = &cs, .tx_data = burst_tx, .rx_data = burst_rx, .length = sizeof(burst_tx), .callback = txn_done, .ctx = (void*)0};
+	spi_txn_t write = {.cs = &cs, .tx_data = write_tx, .rx_data = NULL, .length = sizeof(write_tx), .callback = txn_done, .ctx = (void*)1};
+
+	GPIOD->PCOR = 0;
+	GPIOD->PSOR = 0;
+	CHECK_EQ(spi_submit(&read), SPI_SUCCESS);
+	CHECK_EQ(spi_submit(&write), SPI_SUCCESS);
+	CHECK_EQ(spi_queue_depth(), 2);
+
+	//First transaction is on the bus: CS low and the engine running
+	CHECK_EQ(GPIOD->PCOR, 1 << SPI_CS_PIN);
+	CHECK_EQ(GPIOD->PSOR, 0);
+	check_queue_running(burst_tx, burst_rx, sizeof(burst_tx));
+#if SPI_QUEUE_USE_DMA
+	CHECK(sim_dma_ptr(DMA0->DMA[RX_CH].SAR) == &SPI0->D);
+	CHECK(sim_dma_ptr(DMA0->DMA[RX_CH].DAR) == burst_rx);
+	CHECK(sim_dma_ptr(DMA0->DMA[TX_CH].DAR) == &SPI0->D);
+	CHECK(DMA0->DMA[RX_CH].DCR & DMA_DCR_EINT_MASK);
+	CHECK(!(DMA0->DMA[RX_CH].DCR & DMA_DCR_SINC_MASK));
+	CHECK(!(DMA0->DMA[TX_CH].DCR & DMA_DCR_EINT_MASK));
+	CHECK(DMA0->DMA[TX_CH].DCR & DMA_DCR_SINC_MASK);
+	CHECK(!(DMA0->DMA[TX_CH].DCR & DMA_DCR_DINC_MASK));
+#else
+	//Interrupt driven queue owns the bus, direct DMA transfers are refused
+	uint8_t dummy;
+	CHECK_EQ(SPI_transfer_dma(&cs, NULL, &dummy, 1, NULL, NULL), SPI_BUSY);
+#endif
+
+	//Completion releases CS and starts the second transaction before the callback
+	CHECK_EQ(run_transfer(), sizeof(burst_tx));
+	CHECK(memcmp(burst_rx, burst_tx, sizeof(burst_tx)) == 0); //Loopback model
+	CHECK_EQ(done_mask, 1);
+	CHECK_EQ(GPIOD->PSOR, 1 << SPI_CS_PIN);
+	CHECK_EQ(spi_queue_depth(), 1);
+	check_queue_running(write_tx, NULL, sizeof(write_tx));
+
+	//Queue drains, bus is left idle
+	CHECK_EQ(run_transfer(), sizeof(write_tx));
+	CHECK_EQ(done_mask, 3);
+	CHECK_EQ(last_status, SPI_SUCCESS);
+	CHECK_EQ(spi_queue_depth(), 0);
+	CHECK_EQ(SPI0->C2 & (SPI_C2_RXDMAE_MASK | SPI_C2_TXDMAE_MASK), 0);
+	CHECK(!(SPI0->C1 & SPI_C1_SPIE_MASK));
+	CHECK_EQ(SPI_dma_busy(), 0);
+	CHECK_EQ(sim_irq_disabled, 0);
+
+	spi_get_queue_stats(&stats);
+	CHECK_EQ(stats.completed, 2);
+	CHECK_EQ(stats.max_depth, 2);
+
+	//Direct DMA transfer with nothing to send clocks out 0xFF
+	uint8_t idle_rx[4] = {0};
+	CHECK_EQ(SPI_transfer_dma(&cs, NULL, idle_rx, sizeof(idle_rx), txn_done, (void*)2), SPI_SUCCESS);
+	CHECK_EQ(SPI_transfer_dma(&cs, NULL, idle_rx, sizeof(idle_rx), NULL, NULL), SPI_BUSY);
+	CHECK(!(DMA0->DMA[TX_CH].DCR & DMA_DCR_SINC_MASK));
+	CHECK_EQ(run_transfer(), sizeof(idle_rx));
+	CHECK_EQ(done_mask, 7);
+	for(size_t i = 0; i < sizeof(idle_rx); i++)
+	{
+		CHECK_EQ(idle_rx[i], 0xFF);
+	}
+
+	//Abort drops the queue without callbacks, stops the engine and releases CS
+	done_mask = 0;
+	CHECK_EQ(spi_submit(&read), SPI_SUCCESS);
+	CHECK_EQ(spi_submit(&write), SPI_SUCCESS);
+#if SPI_QUEUE_USE_DMA
+	sim_dma_step(TX_CH); //Stall part way through the first transaction
+#else
+	SPI0_IRQHandler();
+#endif
+	GPIOD->PSOR = 0;
+	CHECK_EQ(spi_abort(), 2);
+	CHECK_EQ(GPIOD->PSOR, 1 << SPI_CS_PIN);
+	CHECK_EQ(spi_queue_depth(), 0);
+	CHECK_EQ(SPI_dma_busy(), 0);
+	CHECK(!(DMA0->DMA[RX_CH].DCR & DMA_DCR_ERQ_MASK));
+	CHECK(!(DMA0->DMA[TX_CH].DCR & DMA_DCR_ERQ_MASK));
+	CHECK_EQ(SPI0->C2 & (SPI_C2_RXDMAE_MASK | SPI_C2_TXDMAE_MASK), 0);
+	CHECK(!(SPI0->C1 & SPI_C1_SPIE_MASK));
+	CHECK_EQ(sim_dma_step(TX_CH), 0);
+	CHECK_EQ(done_mask, 0);
+	CHECK_EQ(sim_irq_disabled, 0);
+
+	//Queue is usable again
+	CHECK_EQ(spi_submit(&write), SPI_SUCCESS);
+	CHECK_EQ(run_transfer(), sizeof(write_tx));
+	CHECK_EQ(done_mask, 2);
+	CHECK_EQ(spi_queue_depth(), 0);
+	CHECK_EQ(last_status, SPI_SUCCESS);
+
+	//Direct transfer owns the bus: the queued one waits for it, then starts from its completion
+	done_mask = 0;
+	CHECK_EQ(SPI_transfer_dma(&cs, NULL, idle_rx, sizeof(idle_rx), txn_done, (void*)2), SPI_SUCCESS);
+	CHECK_EQ(spi_submit(&read), SPI_SUCCESS);
+	CHECK_EQ(spi_queue_depth(), 1);
+	CHECK(sim_dma_ptr(DMA0->DMA[TX_CH].SAR) != burst_tx);
+	CHECK(!(SPI0->C1 & SPI_C1_SPIE_MASK));
+	CHECK_EQ(run_transfer(), sizeof(idle_rx));
+	CHECK_EQ(done_mask, 4);
+	check_queue_running(burst_tx, burst_rx, sizeof(burst_tx));
+	CHECK_EQ(run_transfer(), sizeof(burst_tx));
+	CHECK_EQ(done_mask, 5);
+	CHECK_EQ(spi_queue_depth(), 0);
+	CHECK_EQ(SPI_dma_busy(), 0);
+	CHECK_EQ(sim_irq_disabled, 0);
+
+	//DMA error is reported to the owner instead of a completed transfer
+	done_mask = 0;
+	CHECK_EQ(SPI_transfer_dma(&cs, burst_tx, burst_rx, sizeof(burst_tx), txn_done, (void*)2), SPI_SUCCESS);
+	sim_dma_step(TX_CH);
+	DMA0->DMA[RX_CH].DSR_BCR |= DMA_DSR_BCR_DONE_MASK | DMA_DSR_BCR_BED_MASK; //Bus error writing rx_data
+	GPIOD->PSOR = 0;
+	DMA0_IRQHandler();
+	CHECK_EQ(done_mask, 4);
+	CHECK_EQ(last_status, SPI_BUS_ERROR);
+	CHECK_EQ(GPIOD->PSOR, 1 << SPI_CS_PIN);
+	CHECK(!(DMA0->DMA[RX_CH].DSR_BCR & DMA_DSR_BCR_BED_MASK));
+	CHECK(!(DMA0->DMA[TX_CH].DCR & DMA_DCR_ERQ_MASK));
+	CHECK_EQ(SPI_dma_busy(), 0);
+
+	//Unresolvable buffer address stops the channel with a configuration error
+	done_mask = 0;
+	CHECK_EQ(SPI_transfer_dma(&cs, NULL, NULL, 1, txn_done, (void*)2), SPI_SUCCESS);
+	DMA0->DMA[RX_CH].DAR = 0; //Never handed out by DMA_ADDR
+	sim_dma_step(TX_CH);
+	CHECK_EQ(sim_dma_step(RX_CH), 0);
+	CHECK_EQ(DMA0->DMA[RX_CH].DSR_BCR & (DMA_DSR_BCR_CE_MASK | DMA_DSR_BCR_DONE_MASK), DMA_DSR_BCR_CE_MASK | DMA_DSR_BCR_DONE_MASK);
+	DMA0_IRQHandler();
+	CHECK_EQ(done_mask, 4);
+	CHECK_EQ(last_status, SPI_BUS_ERROR);
+	CHECK_EQ(SPI_dma_busy(), 0);
+
+#if SPI_QUEUE_USE_DMA
+	//Error on a queued transaction reaches its callback, the queue moves on
+	done_mask = 0;
+	CHECK_EQ(spi_submit(&read), SPI_SUCCESS);
+	CHECK_EQ(spi_submit(&write), SPI_SUCCESS);
+	sim_dma_step(TX_CH);
+	DMA0->DMA[RX_CH].DSR_BCR |= DMA_DSR_BCR_DONE_MASK | DMA_DSR_BCR_BED_MASK;
+	DMA0_IRQHandler();
+	CHECK_EQ(done_mask, 1);
+	CHECK_EQ(last_status, SPI_BUS_ERROR);
+	check_queue_running(write_tx, NULL, sizeof(write_tx));
+	CHECK_EQ(run_transfer(), sizeof(write_tx));
+	CHECK_EQ(done_mask, 3);
+	CHECK_EQ(last_status, SPI_SUCCESS);
+#endif
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,335 @@
+/***********************************************************************************
+* @file test_spi_stream.c
+ * @brief:Timing model of SPI0 behind the simulated register file: a transmit
+ *        buffer, a shifter that takes 8 SCK periods per byte at the divider
+ *        in BR, and a receive buffer. Every register access costs the CPU a
+ *        fixed number of bus cycles. Runs the byte-at-a-time loop of
+ *        SPI_write_byte/SPI_read_byte and the streaming SPI_transfer over
+ *        the model, measures the gaps between bytes and the bus
+ *        utilisation, and checks that streaming keeps two bytes in flight.
+ *        Also checks that a transfer after spi_abort does not pick up the
+ *        reply of a byte that was still on the wire.
+ * @author Sayali Mule
+ * @date 12/04/2021
+ * @Reference: KL25 Sub-Family Reference Manual chapter 37 (SPI)
+ *****************************************************************************/
+//***********************************************************************************
+//                              Include files
+//***********************************************************************************
+#include <string.h>
+#include "reg_access.h"
+#include "gpio.h"
+#include "spi.h"
+#include "test_util.h"
+
+//***********************************************************************************
+//                                  Macros
+//***********************************************************************************
+#define ACCESS_CYCLES		(4) //Bus cycles per register access with the loop around it, 8 core cycles at 48 MHz
+#define MODEL_BYTES			(64) //Bytes timed per transfer
+#define BURST_LEN			(9) //BME280 measurement burst, address and 8 data bytes
+
+//The model tells a write of D from a read by the value left in D: the bus
+//carries bytes with bit 7 set from the master and bit 7 clear from the slave
+#define REPLY(byte)			((uint8_t)((byte) & 0x7F))
+
+//State of the modelled SPI0, times in bus cycles
+typedef struct
+{
+	uint64_t now;
+	uint8_t shifting;
+	uint8_t shift_byte;
+	uint64_t shift_end;
+	uint8_t tx_full; //SPTEF clear
+	uint8_t tx_byte;
+	uint8_t rx_full; //SPRF set
+	uint8_t rx_byte;
+	uint8_t last_d; //D as the previous access saw it
+	uint8_t last_sprf; //SPRF as the previous access saw it
+	uint8_t sprf_seen; //Previous access was the status read that found SPRF set
+	uint8_t max_in_flight; //Bytes shifting or buffered right after a write
+	uint32_t overruns; //Bytes received while SPRF was still set
+	uint32_t lost_writes; //D written while SPTEF was clear
+	uint32_t bytes; //Bytes started since spi_model_begin
+	uint64_t start[MODEL_BYTES];
+	uint64_t end[MODEL_BYTES];
+}spi_model_t;
+
+//Timing of one transfer
+typedef struct
+{
+	uint64_t span; //First byte started to last byte done
+	uint64_t max_gap; //Longest idle time between two bytes
+	double utilisation; //Share of the span the shifter was busy
+}spi_timing_t;
+
+//***********************************************************************************
+//                              Global variables
+//***********************************************************************************
+static spi_model_t model;
+
+//***********************************************************************************
+//                                  Function definition
+//***********************************************************************************
+static uint32_t byte_cycles(void)
+{
+	uint8_t br = sim_SPI0.BR;
+	uint32_t sppr = (br & SPI_BR_SPPR_MASK) >> SPI_BR_SPPR_SHIFT;
+	uint32_t spr = (br & SPI_BR_SPR_MASK) >> SPI_BR_SPR_SHIFT;
+
+	return 8 * ((sppr + 1) << (spr + 1));
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Move the buffered byte into the shifter
+ @param: at: Bus cycle at which shifting starts
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void shift_start(uint64_t at)
+{
+	model.shift_byte = model.tx_byte;
+	model.tx_full = 0;
+	model.shifting = 1;
+	model.shift_end = at + byte_cycles();
+	if(model.bytes < MODEL_BYTES)
+	{
+		model.start[model.bytes] = at;
+	}
+	model.bytes++;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: sim_spi0_hook. Works out what the previous access did, lets the
+ 	 	 shifter run for the time of this access and presents S and D.
+ 	 	 A changed D was a write. The access after a status read that
+ 	 	 showed SPRF is taken as the read of D that clears it, which is how
+ 	 	 every loop in spi.c is written.
+ @param: None
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void spi_model_access(void)
+{
+	if(sim_SPI0.D != model.last_d)
+	{
+		if(model.tx_full)
+		{
+			model.lost_writes++;
+		}
+		model.tx_full = 1;
+		model.tx_byte = sim_SPI0.D;
+		model.sprf_seen = 0;
+
+		uint8_t in_flight = model.shifting + model.tx_full;
+		if(in_flight > model.max_in_flight)
+		{
+			model.max_in_flight = in_flight;
+		}
+	}
+	else if(model.sprf_seen)
+	{
+		model.rx_full = 0;
+		model.sprf_seen = 0;
+	}
+	else
+	{
+		model.sprf_seen = model.last_sprf;
+	}
+
+	if(!model.shifting && model.tx_full)
+	{
+		shift_start(model.now);
+	}
+
+	model.now += ACCESS_CYCLES;
+	while(model.shifting && model.shift_end <= model.now)
+	{
+		if(model.rx_full)
+		{
+			model.overruns++;
+		}
+		model.rx_full = 1;
+		model.rx_byte = REPLY(model.shift_byte);
+		if(model.bytes <= MODEL_BYTES)
+		{
+			model.end[model.bytes - 1] = model.shift_end;
+		}
+
+		model.shifting = 0;
+		if(model.tx_full)
+		{
+			shift_start(model.shift_end); //Buffered byte follows without a gap
+		}
+	}
+
+	sim_SPI0.S = (model.tx_full ? 0 : SPI_S_SPTEF_MASK) | (model.rx_full ? SPI_S_SPRF_MASK : 0);
+	sim_SPI0.D = model.rx_byte;
+	model.last_d = model.rx_byte;
+	model.last_sprf = model.rx_full;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Start timing a transfer with the SPI idle
+ @param: None
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void spi_model_begin(void)
+{
+	memset(&model, 0, sizeof(model));
+	sim_SPI0.S = SPI_S_SPTEF_MASK;
+	sim_SPI0.D = 0;
+	sim_spi0_hook = spi_model_access;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Timing of the bytes started since spi_model_begin
+ @param: None
+ @return:Span, longest gap and utilisation
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static spi_timing_t spi_model_timing(void)
+{
+	spi_timing_t timing = {0};
+	uint32_t bytes = model.bytes;
+
+	CHECK(bytes > 0 && bytes <= MODEL_BYTES);
+	CHECK(!model.shifting);
+	for(uint32_t i = 1; i < bytes; i++)
+	{
+		uint64_t gap = model.start[i] - model.end[i - 1];
+		if(gap > timing.max_gap)
+		{
+			timing.max_gap = gap;
+		}
+	}
+	timing.span = model.end[bytes - 1] - model.start[0];
+	timing.utilisation = (double)bytes * byte_cycles() / timing.span;
+
+	return timing;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Full duplex transfer the way spi.c did it before streaming, waiting
+ 	 	 for each byte to come back before sending the next
+ @param: tx_data: Bytes to send
+ 	 	 rx_data: Buffer for received bytes
+ 	 	 length: Number of bytes
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void byte_loop_transfer(const uint8_t* tx_data, uint8_t* rx_data, size_t length)
+{
+	for(size_t i = 0; i < length; i++)
+	{
+		SPI_write_byte(tx_data[i]);
+		SPI_read_byte(&rx_data[i]);
+	}
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Received bytes are the slave's reply to every byte sent and no
+ 	 	 byte was lost on either side
+ @param: tx_data, rx_data: Bytes sent and received
+ 	 	 length: Number of bytes
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void check_transfer(const uint8_t* tx_data, const uint8_t* rx_data, size_t length)
+{
+	CHECK_EQ(model.bytes, length);
+	CHECK_EQ(model.overruns, 0);
+	CHECK_EQ(model.lost_writes, 0);
+	for(size_t i = 0; i < length; i++)
+	{
+		CHECK_EQ(rx_data[i], REPLY(tx_data[i]));
+	}
+}
+
+int main(void)
+{
+	const uint32_t rates_hz[] = {SPI_DEFAULT_FREQ_HZ, SIM_BUS_CLOCK_HZ / 2};
+	const spi_cs_t cs = {SPI_CS_PORT, SPI_CS_PIN};
+	uint8_t tx[MODEL_BYTES];
+	uint8_t rx[MODEL_BYTES];
+
+	for(size_t i = 0; i < MODEL_BYTES; i++)
+	{
+		tx[i] = (uint8_t)(0x80 | (i * 37));
+	}
+
+	sim_peripherals_reset();
+	gpio_init();
+	spi_init();
+
+	for(size_t r = 0; r < sizeof(rates_hz) / sizeof(rates_hz[0]); r++)
+	{
+		uint32_t hz = spi_set_frequency(rates_hz[r]);
+
+		//Byte loop: one byte in flight, the bus idles while the CPU turns around
+		spi_model_begin();
+		byte_loop_transfer(tx, rx, MODEL_BYTES);
+		spi_timing_t loop = spi_model_timing();
+		check_transfer(tx, rx, MODEL_BYTES);
+		CHECK_EQ(model.max_in_flight, 1);
+		CHECK(loop.max_gap > 0);
+
+		//Streaming: the next byte waits in the transmit buffer, bytes go out back-to-back
+		memset(rx, 0, sizeof(rx));
+		spi_model_begin();
+		SPI_transfer(tx, rx, MODEL_BYTES);
+		spi_timing_t stream = spi_model_timing();
+		check_transfer(tx, rx, MODEL_BYTES);
+		CHECK_EQ(model.max_in_flight, 2);
+		CHECK_EQ(stream.max_gap, 0);
+		CHECK_EQ(stream.span, (uint64_t)MODEL_BYTES * byte_cycles());
+
+		printf("SCK %lu Hz, %u bytes: byte loop %.0f%% bus utilisation (gaps up to %lu bus cycles), streaming %.0f%%\n",
+			   (unsigned long)hz, MODEL_BYTES, loop.utilisation * 100, (unsigned long)loop.max_gap, stream.utilisation * 100);
+		CHECK(stream.utilisation > loop.utilisation);
+
+		//BME280 burst read: address prefix and data stream without a gap
+		uint8_t burst[BURST_LEN - 1];
+		spi_model_begin();
+		SPI_multibyte_read_register(&cs, 0xF7, burst, sizeof(burst));
+		spi_timing_t read = spi_model_timing();
+		CHECK_EQ(model.bytes, BURST_LEN);
+		CHECK_EQ(model.overruns, 0);
+		CHECK_EQ(read.max_gap, 0);
+		for(size_t i = 0; i < sizeof(burst); i++)
+		{
+			CHECK_EQ(burst[i], REPLY(0xFF));
+		}
+	}
+
+	//Abort with a DMA transfer part way: the byte on the wire completes while
+	//the channels are stopped, its reply must not become the first byte
+	//received by the next transfer
+	spi_model_begin();
+	CHECK_EQ(SPI_transfer_dma(&cs, tx, rx, BURST_LEN, NULL, NULL), SPI_SUCCESS);
+	CHECK(sim_dma_step(SPI_DMA_TX_CHANNEL)); //First byte written to D
+	CHECK_EQ(spi_abort(), 0);
+	CHECK_EQ(model.bytes, 1);
+	CHECK(!model.shifting);
+	CHECK(!model.rx_full);
+
+	memset(rx, 0, sizeof(rx));
+	SPI_transfer(&tx[1], rx, BURST_LEN);
+	CHECK_EQ(model.bytes, 1 + BURST_LEN);
+	CHECK_EQ(model.overruns, 0);
+	for(size_t i = 0; i < BURST_LEN; i++)
+	{
+		CHECK_EQ(rx[i], REPLY(tx[1 + i]));
+	}
+
+	CHECK_EQ(sim_irq_disabled, 0);
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,119 @@
+/***********************************************************************************
+* @file test_statemachine.c
+ * @brief:Runs the weather monitor state machine over the register map model
+ *        of sim_bme280.c with only the outdoor sensor on the bus, and
+ *        reads the bluetooth frames back from the UART1 model. The sensor
+ *        that answers must keep its number although it is the only one
+ *        left after init.
+ * @author Sayali Mule
+ * @date 12/04/2021
+ * @Reference:
+ *****************************************************************************/
+//***********************************************************************************
+//                              Include files
+//***********************************************************************************
+#include <string.h>
+#include "sim_bme280.h"
+#include "gpio.h"
+#include "statemachine.h"
+#include "systick.h"
+#include "uart.h"
+#include "test_util.h"
+
+//***********************************************************************************
+//                                  Macros
+//***********************************************************************************
+#define PERIODS			(3)
+#define MAX_STEPS		(100) //State machine steps allowed for one period
+#define TICKS_PER_US	(3) //Core clock / 16
+#define STEP_US			(1000) //Time that passes between two steps
+#define WIRE_LEN		(1024)
+
+void UART1_IRQHandler(void);
+void SysTick_Handler(void);
+
+static const bme280_calib_t calib =
+{
+	.dig_T1 = 27504, .dig_T2 = 26435, .dig_T3 = -1000,
+	.dig_P1 = 36477, .dig_P2 = -10685, .dig_P3 = 3024, .dig_P4 = 2855, .dig_P5 = 140,
+	.dig_P6 = -7, .dig_P7 = 15500, .dig_P8 = -14600, .dig_P9 = 6000,
+	.dig_H1 = 75, .dig_H2 = 362, .dig_H3 = 0, .dig_H4 = 313, .dig_H5 = 50, .dig_H6 = 30
+};
+
+static const bme280_raw_t raw = {.adc_P = 415148, .adc_T = 519888, .adc_H = 28000};
+
+//***********************************************************************************
+//                              Global variables
+//***********************************************************************************
+static char wire[WIRE_LEN + 1]; //Bytes shifted out by the model, room for a terminator
+static size_t wire_len = 0;
+
+//***********************************************************************************
+//                                  Function definition
+//***********************************************************************************
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Send everything queued for UART1, one interrupt per byte time
+ @param: None
+ @return:None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void run_link(void)
+{
+	while(UART1->C2 & UART_C2_TIE_MASK)
+	{
+		UART1_IRQHandler();
+
+		if(UART1->C2 & UART_C2_TIE_MASK)
+		{
+			CHECK(wire_len < WIRE_LEN);
+			wire[wire_len++] = UART1->D;
+		}
+	}
+}
+
+int main(void)
+{
+	sim_peripherals_reset();
+	sim_bme280_reset();
+	systick_init();
+	uart1_init();
+
+	//Indoor sensor missing, outdoor sensor is the second one in the table
+	sim_bme280_t* outdoor = sim_bme280_attach(OUTDOOR_CS_PIN, &calib);
+	sim_bme280_set_raw(outdoor, &raw);
+	weather_monitor_init();
+
+	for(uint32_t period = 0; period < PERIODS; period++)
+	{
+		//Counter reloads and the timer event starts a period
+		SysTick->VAL = SysTick->LOAD;
+		SysTick_Handler();
+
+		for(uint32_t step = 0; step < MAX_STEPS && cbfifo_length(&uart1_tx_fifo) == 0; step++)
+		{
+			weather_monitor_statemachine();
+			SysTick->VAL -= STEP_US * TICKS_PER_US;
+		}
+		run_link();
+	}
+	wire[wire_len] = '\0';
+
+	CHECK_EQ(outdoor->conversions, PERIODS);
+	CHECK(wire_len > 0);
+
+	//Every frame carries the number of the sensor, not its place among the ones that answered
+	unsigned frames = 0;
+	for(const char* frame = strstr(wire, "S: "); frame != NULL; frame = strstr(frame + 1, "S: "))
+	{
+		unsigned id = 0;
+
+		CHECK_EQ(sscanf(frame, "S: %u", &id), 1);
+		CHECK_EQ(id, 2);
+		frames++;
+	}
+	CHECK_EQ(frames, PERIODS);
+	CHECK_EQ(sim_irq_disabled, 0);
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,89 @@
+/***********************************************************************************
+* @file test_systick.c
+ * @brief:Walks the SysTick counter through several reloads and delivers
+ *        SysTick_Handler late, as happens while interrupts are masked or a
+ *        higher priority interrupt runs. get_time_us must never go backwards
+ *        and must stay on the true elapsed time in that window.
+ * @author Sayali Mule
+ * @date 12/04/2021
+ * @Reference:
+ *****************************************************************************/
+//***********************************************************************************
+//                              Include files
+//***********************************************************************************
+#include "reg_access.h"
+#include "systick.h"
+#include "test_util.h"
+
+//***********************************************************************************
+//                                  Macros
+//***********************************************************************************
+#define TICKS_PER_US		(3) //Core clock / 16
+#define STEP_TICKS			(997) //Prime, so samples land everywhere in the period
+#define HANDLER_DELAY_TICKS	(30000) //Handler runs 10ms after the reload
+#define PERIODS				(3)
+
+void SysTick_Handler(void);
+
+//***********************************************************************************
+//                                  Function definition
+//***********************************************************************************
+int main(void)
+{
+	uint64_t ticks = 0;
+	uint32_t handled = 0;
+	uint32_t last_us = 0;
+	uint32_t backwards = 0;
+	uint32_t off = 0;
+	uint32_t pending_samples = 0;
+
+	sim_peripherals_reset();
+	systick_init();
+
+	uint64_t period_ticks = (uint64_t)SysTick->LOAD + 1;
+
+	while(ticks < PERIODS * period_ticks + HANDLER_DELAY_TICKS)
+	{
+		ticks += STEP_TICKS;
+
+		uint32_t reloads = (uint32_t)(ticks / period_ticks);
+		uint32_t in_period = (uint32_t)(ticks % period_ticks);
+
+		SysTick->VAL = SysTick->LOAD - in_period;
+		if(reloads > handled)
+		{
+			SCB->ICSR |= SCB_ICSR_PENDSTSET_Msk; //Reloaded, handler not run yet
+			if(in_period >= HANDLER_DELAY_TICKS)
+			{
+				SCB->ICSR &= ~SCB_ICSR_PENDSTSET_Msk; //Cleared on exception entry
+				SysTick_Handler();
+				handled++;
+			}
+			else
+			{
+				pending_samples++;
+			}
+		}
+
+		uint32_t now_us = get_time_us();
+		int64_t error_us = (int64_t)now_us - (int64_t)(ticks / TICKS_PER_US);
+
+		if(now_us < last_us)
+		{
+			backwards++;
+		}
+		if(error_us > 1 || error_us < -(int64_t)(reloads + 1)) //Period is rounded down to whole us
+		{
+			off++;
+		}
+		last_us = now_us;
+	}
+
+	printf("%u samples taken with the reload pending\n", pending_samples);
+	CHECK(pending_samples > 0);
+	CHECK_EQ(handled, PERIODS);
+	CHECK_EQ(backwards, 0);
+	CHECK_EQ(off, 0);
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,264 @@
+/***********************************************************************************
+* @file test_uart1.c
+ * @brief:Sends sensor frames through a model of UART1 at 9600 baud, built
+ *        once per transmit path. With UART1_TX_USE_DMA at 0 the transmit
+ *        interrupt is delivered once per byte time while TIE is set, at 1
+ *        the DMA channel moves one byte per byte time and DMA2_IRQHandler
+ *        runs when the frame is done. Checks the bytes on the wire, that
+ *        transmit_sensors_val returns with interrupts enabled and the frame
+ *        handed to the interrupt or the DMA channel before any byte is out,
+ *        that a stalled link keeps the newest whole frames, and counts the
+ *        interrupts taken per frame. Frames go out of the ring in place,
+ *        also when they wrap around its end, and a frame partly on the
+ *        wire is not dropped when the ring overflows. Times are printed,
+ *        not checked.
+ * @author Sayali Mule
+ * @date 12/04/2021
+ * @Reference: KL25 Sub-Family Reference Manual chapter 23 (DMA) and 40 (UART)
+ *****************************************************************************/
+//***********************************************************************************
+//                              Include files
+//***********************************************************************************
+#include <string.h>
+#include <time.h>
+#include "sim_bme280.h"
+#include "uart.h"
+#include "test_util.h"
+
+//***********************************************************************************
+//                                  Macros
+//***********************************************************************************
+#define BYTE_US				(10 * 1000000.0 / 9600) //Start, 8 data and stop bit
+#define WIRE_LEN			(4096)
+#define STALL_FRAMES		(10)
+#define STALL_SENT			(2) //Bytes of the first stalled frame out before the rest are queued, up to its sensor id
+#define MEASURE_FRAMES		(1000)
+#define CLOCK_CALIBRATION	(100000) //Timer reads to measure the cost of one
+
+#if UART1_TX_USE_DMA
+#define TX_PATH				"DMA"
+#else
+#define TX_PATH				"per byte interrupt"
+#endif
+
+void UART1_IRQHandler(void);
+void DMA2_IRQHandler(void);
+
+//***********************************************************************************
+//                              Global variables
+//***********************************************************************************
+static const sensor_val_t example = {.temp_val = 2508, .pressure_val = 25767233, .hum_val = 47445};
+static const char example_frame[] = "S: 1 \nT: 25.08 C \nP: 100653.25 Pa \nH: 46.33 %RH \n\n***************\n";
+
+static uint8_t wire[WIRE_LEN + 1]; //Bytes shifted out by the model, room for a terminator
+static size_t wire_len = 0;
+
+static uint32_t interrupts = 0; //Handler calls made by the model
+static double handler_us = 0; //Time spent in them, timer cost included
+static double clock_us = 0; //Cost of one pair of timer reads
+
+//***********************************************************************************
+//                                  Function definition
+//***********************************************************************************
+static double now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Take one interrupt like the NVIC would, counted and timed
+ @param: handler: Vector to run
+ @return: None
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static void take_interrupt(void (*handler)(void))
+{
+	double start = now_us();
+
+	handler();
+	handler_us += now_us() - start;
+	interrupts++;
+}
+
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+/*
+ @brief: Let the link run for up to max_bytes byte times, or until the
+ 	 	 driver has nothing left to send.
+ 	 	 Interrupt path: each interrupt either writes one byte to D and keeps
+ 	 	 TIE set, or finds nothing to send and clears TIE.
+ 	 	 DMA path: each byte time the channel moves one byte to D, the channel
+ 	 	 interrupt runs once its byte count reaches zero.
+ @param: max_bytes: Byte times to run for
+ @return:Bytes shifted out
+ */
+/*-----------------------------------------------------------------------------------------------------------------------------*/
+static size_t run_link_for(size_t max_bytes)
+{
+	size_t sent = 0;
+
+#if UART1_TX_USE_DMA
+	while(sent < max_bytes && sim_dma_step(UART1_DMA_CHANNEL))
+	{
+		CHECK(wire_len < WIRE_LEN);
+		wire[wire_len++] = UART1->D;
+		sent++;
+
+		if((DMA0->DMA[UART1_DMA_CHANNEL].DSR_BCR & DMA_DSR_BCR_DONE_MASK) &&
+		   (DMA0->DMA[UART1_DMA_CHANNEL].DCR & DMA_DCR_EINT_MASK))
+		{
+			take_interrupt(DMA2_IRQHandler); //May start the next frame
+		}
+	}
+	CHECK(!(DMA0->DMA[UART1_DMA_CHANNEL].DSR_BCR & DMA_DSR_BCR_CE_MASK));
+#else
+	while(sent < max_bytes && (UART1->C2 & UART_C2_TIE_MASK))
+	{
+		take_interrupt(UART1_IRQHandler); //TDRE is left set by the model, one call per byte time
+
+		if(UART1->C2 & UART_C2_TIE_MASK)
+		{
+			CHECK(wire_len < WIRE_LEN);
+			wire[wire_len++] = UART1->D;
+			sent++;
+		}
+	}
+#endif
+
+	return sent;
+}
+
+static size_t run_link(void)
+{
+	return run_link_for(SIZE_MAX);
+}
+
+int main(void)
+{
+	cb_stats_t stats;
+	char expected[128];
+	double start;
+	size_t frame_len = strlen(example_frame);
+
+	sim_peripherals_reset();
+	uart1_init();
+
+	//One frame: the call only formats into the ring, the link does the rest
+	start = now_us();
+	transmit_sensors_val(1, (sensor_val_t*)&example);
+	double blocked_us = now_us() - start;
+
+	//Returns before the first byte is out, with the whole frame left to the hardware
+	CHECK_EQ(sim_irq_disabled, 0);
+	CHECK_EQ(wire_len, 0);
+#if UART1_TX_USE_DMA
+	CHECK(DMA0->DMA[UART1_DMA_CHANNEL].DCR & DMA_DCR_ERQ_MASK);
+	CHECK_EQ(DMA0->DMA[UART1_DMA_CHANNEL].DSR_BCR & DMA_DSR_BCR_BCR_MASK, frame_len);
+	volatile uint8_t* src = sim_dma_ptr(DMA0->DMA[UART1_DMA_CHANNEL].SAR);
+	CHECK(src > uart1_tx_fifo.buffer && src < uart1_tx_fifo.buffer + UART1_TX_FIFO_LEN); //In place, behind the length byte
+#else
+	CHECK(UART1->C2 & UART_C2_TIE_MASK);
+	CHECK_EQ(cbfifo_length(&uart1_tx_fifo), 1 + frame_len); //Length byte and frame, not taken yet
+#endif
+	CHECK_EQ(run_link(), frame_len);
+	CHECK(memcmp(wire, example_frame, frame_len) == 0);
+	CHECK(!uart1_busy());
+
+	printf("%s: main loop blocked %.1f us for a %u byte frame, polling TDRE would block %.0f us\n",
+		   TX_PATH, blocked_us, (unsigned)frame_len, frame_len * BYTE_US);
+
+	//Interrupts per frame on an idle link
+	for(uint32_t i = 0; i < CLOCK_CALIBRATION; i++)
+	{
+		start = now_us();
+		clock_us += now_us() - start;
+	}
+	clock_us /= CLOCK_CALIBRATION;
+
+	interrupts = 0;
+	handler_us = 0;
+	size_t wrapped = 0;
+	for(uint32_t i = 0; i < MEASURE_FRAMES; i++)
+	{
+		wrapped += ((uart1_tx_fifo.head + 1) & uart1_tx_fifo.mask) + frame_len > UART1_TX_FIFO_LEN;
+		wire_len = 0;
+		transmit_sensors_val(1, (sensor_val_t*)&example);
+		CHECK_EQ(run_link(), frame_len);
+		CHECK(memcmp(wire, example_frame, frame_len) == 0);
+	}
+	CHECK(wrapped > 0);
+
+	double cpu_ns = (handler_us - interrupts * clock_us) * 1000.0 / MEASURE_FRAMES;
+	printf("%s: %.1f interrupts and %.0f ns in handlers per %u byte frame, %u frames wrapped around the ring\n",
+		   TX_PATH, (double)interrupts / MEASURE_FRAMES, cpu_ns > 0 ? cpu_ns : 0, (unsigned)frame_len, (unsigned)wrapped);
+#if UART1_TX_USE_DMA
+	CHECK_EQ(interrupts, MEASURE_FRAMES); //Only the end of the frame, the channel wraps with the ring
+#else
+	CHECK_EQ(interrupts, MEASURE_FRAMES * (frame_len + 1)); //Every byte and the one that finds the frame done
+#endif
+
+	//Stalled link: ring keeps the newest frames, whole, and counts what it dropped.
+	//The first frame is partly on the wire and must not be dropped.
+	cbfifo_get_stats(&uart1_tx_fifo, &stats);
+	size_t overwritten = stats.overwritten;
+
+	wire_len = 0;
+	transmit_sensors_val(1, (sensor_val_t*)&example);
+	CHECK_EQ(run_link_for(STALL_SENT), STALL_SENT);
+	for(uint8_t id = 2; id <= STALL_FRAMES; id++)
+	{
+		transmit_sensors_val(id, (sensor_val_t*)&example);
+	}
+	CHECK_EQ(sim_irq_disabled, 0);
+	run_link();
+	wire[wire_len] = '\0';
+	CHECK(memcmp(wire, example_frame, frame_len) == 0);
+
+	unsigned last_id = 0;
+	unsigned delivered = 0;
+	size_t pos = 0;
+
+	//Frames on the wire are whole, in order and end with the newest one
+	while(pos < wire_len)
+	{
+		unsigned id = 0;
+
+		CHECK_EQ(sscanf((const char*)&wire[pos], "S: %u", &id), 1);
+		CHECK(id > last_id);
+		if(id <= last_id)
+		{
+			break;
+		}
+		snprintf(expected, sizeof(expected), "S: %u %s", id, &example_frame[5]);
+		CHECK(pos + strlen(expected) <= wire_len);
+		CHECK(memcmp(&wire[pos], expected, strlen(expected)) == 0);
+		pos += strlen(expected);
+		last_id = id;
+		delivered++;
+	}
+
+	printf("%s: stalled link delivered %u of %u frames, the last %u\n", TX_PATH, delivered, STALL_FRAMES, last_id);
+	CHECK_EQ(last_id, STALL_FRAMES);
+	CHECK(delivered < STALL_FRAMES);
+
+	cbfifo_get_stats(&uart1_tx_fifo, &stats);
+	CHECK_EQ(stats.overwritten - overwritten, (STALL_FRAMES - delivered) * (frame_len + 1)); //Length byte and frame
+
+	//Message longer than a frame can be is refused, nothing is queued
+	static uint8_t long_msg[UART1_FRAME_MAX + 2];
+	memset(long_msg, 'x', sizeof(long_msg) - 1);
+	CHECK_EQ(uart1_puts(long_msg), 0);
+	CHECK_EQ(cbfifo_length(&uart1_tx_fifo), 0);
+
+	//Text running past the reservation drops the frame instead of a partial one
+	uart1_frame_t frame;
+	CHECK(uart1_frame_begin(&frame, 4));
+	uart1_frame_puts(&frame, "12345");
+	CHECK_EQ(uart1_frame_end(&frame), 0);
+	CHECK_EQ(cbfifo_length(&uart1_tx_fifo), 0);
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,47 @@
+/***********************************************************************************
+* @file test_util.h
+ * @brief:Minimal check macros for the host tests. A failed check prints its
+ *        location and the test carries on, main returns the failure count.
+ * @author Sayali Mule
+ * @date 12/04/2021
+ * @Reference:
+ *****************************************************************************/
+#ifndef TEST_UTIL_H_
+#define TEST_UTIL_H_
+//***********************************************************************************
+//                              Include files
+//***********************************************************************************
+#include <stdio.h>
+#include <stdint.h>
+
+//***********************************************************************************
+//                                  Macros
+//***********************************************************************************
+static int test_failures = 0;
+
+#define CHECK(cond)																\
+	do																			\
+	{																			\
+		if(!(cond))																\
+		{																		\
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);	\
+			test_failures++;													\
+		}																		\
+	}while(0)
+
+#define CHECK_EQ(actual, expected)												\
+	do																			\
+	{																			\
+		long long a_ = (long long)(actual);										\
+		long long e_ = (long long)(expected);									\
+		if(a_ != e_)															\
+		{																		\
+			printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__,	\
+				   #actual, a_, e_);											\
+			test_failures++;													\
+		}																		\
+	}while(0)
+
+#define TEST_RESULT()	(test_failures == 0 ? 0 : 1)
+
+#endif /* TEST_UTIL_H_ */
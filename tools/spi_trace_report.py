@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""Turn the output of the 'trace' console command into per-sample SPI bus time.
+
+Capture the UART0 console output into a file (or pipe it in), then run
+    python3 spi_trace_report.py capture.txt [--period-ms 4815.19]
+
+Chip select cycles closer together than --gap-ms are grouped into one sample,
+i.e. one run of the weather monitor state machine. For every sample the script
+prints the total time CS was held low, its share of the sampling period and a
+breakdown by register and direction.
+
+The sampling period is the median time between the starts of two samples in
+the trace. With fewer than two samples it is worked out like systick_init does.
+"""
+import argparse
+import statistics
+import sys
+from collections import OrderedDict
+
+US_WRAP = 1 << 32  # start_us is a free-running 32 bit counter
+
+# systick_init writes 48000000 to the 24 bit LOAD register, which keeps the low
+# 24 bits. The counter runs at core clock / 16.
+SYSTICK_LOAD = 48000000 & 0xFFFFFF
+SYSTICK_HZ = 48000000 // 16
+FIRMWARE_PERIOD_US = (SYSTICK_LOAD + 1) * 1e6 / SYSTICK_HZ  # About 4815.19 ms
+
+
+def parse(lines):
+    entries = []
+    in_dump = False
+    for raw in lines:
+        line = raw.strip()
+        if line.startswith("SPI trace begin"):
+            in_dump = True
+            entries = []  # Keep only the last dump of the capture
+            continue
+        if line.startswith("SPI trace end"):
+            in_dump = False
+            continue
+        if not in_dump or not line or line.startswith("seq,"):
+            continue
+        fields = line.split(",")
+        if len(fields) != 6:
+            continue
+        seq, start_us, cs_low_us, reg, direction, length = fields
+        entries.append({
+            "seq": int(seq),
+            "start_us": int(start_us),
+            "cs_low_us": int(cs_low_us),
+            "reg": int(reg, 16),
+            "dir": direction,
+            "len": int(length),
+        })
+    return entries
+
+
+def elapsed(later, earlier):
+    return (later - earlier) % US_WRAP
+
+
+def group_samples(entries, gap_us):
+    samples = []
+    for entry in entries:
+        if samples and elapsed(entry["start_us"], samples[-1][-1]["start_us"]) <= gap_us:
+            samples[-1].append(entry)
+        else:
+            samples.append([entry])
+    return samples
+
+
+def trace_period_us(samples):
+    """Median time between the starts of consecutive samples, None if there is only one."""
+    starts = [sample[0]["start_us"] for sample in samples]
+    deltas = [elapsed(later, earlier) for earlier, later in zip(starts, starts[1:])]
+    return statistics.median(deltas) if deltas else None
+
+
+def report(samples, period_us, out):
+    for index, sample in enumerate(samples):
+        bus_us = sum(e["cs_low_us"] for e in sample)
+        span_us = elapsed(sample[-1]["start_us"] + sample[-1]["cs_low_us"], sample[0]["start_us"])
+        out.write("Sample %d at %d us: %d transactions, CS low %d us (%.3f%% of %.2f ms), span %d us\n"
+                  % (index, sample[0]["start_us"], len(sample), bus_us,
+                     100.0 * bus_us / period_us, period_us / 1000, span_us))
+
+        breakdown = OrderedDict()
+        for e in sample:
+            key = (e["reg"], e["dir"])
+            count, total_us, total_bytes = breakdown.get(key, (0, 0, 0))
+            breakdown[key] = (count + 1, total_us + e["cs_low_us"], total_bytes + e["len"])
+
+        for (reg, direction), (count, total_us, total_bytes) in breakdown.items():
+            out.write("    0x%02X %s  x%-3d %6d us  %5d bytes\n" % (reg, direction, count, total_us, total_bytes))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("capture", nargs="?", help="console capture, stdin if omitted")
+    parser.add_argument("--period-ms", type=float, help="sampling period of the station, taken from the trace by default")
+    parser.add_argument("--gap-ms", type=int, default=500, help="idle time that separates two samples")
+    args = parser.parse_args()
+
+    stream = open(args.capture) if args.capture else sys.stdin
+    with stream:
+        entries = parse(stream)
+
+    if not entries:
+        sys.exit("No SPI trace found, was the firmware built with SPI_TRACE_ENABLE=1?")
+
+    samples = group_samples(entries, args.gap_ms * 1000)
+    if args.period_ms is not None:
+        period_us = args.period_ms * 1000
+    else:
+        period_us = trace_period_us(samples) or FIRMWARE_PERIOD_US
+    sys.stdout.write("Sampling period %.2f ms\n" % (period_us / 1000))
+
+    report(samples, period_us, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()